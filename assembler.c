@@ -0,0 +1,267 @@
+#include "assembler.h"
+#include "cache.h"
+#include "expr.h"
+#include "helper.h"
+#include "module.h"
+#include "parser.h"
+#include "symbol.h"
+#include "types.h"
+#include "writer.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// an A-instruction expression that needs labels defined further down
+typedef struct {
+  uint32_t offset;
+  int lineNumber;
+  int expressionPos;
+  char *instruction;
+} PendingExpression;
+
+typedef struct {
+  PendingExpression *items;
+  size_t count;
+  size_t capacity;
+} PendingExpressions;
+
+static void defer_expression(PendingExpressions *pending, const Parser *parser, size_t offset) {
+  if (pending->count == pending->capacity) {
+    size_t new_capacity = pending->capacity ? pending->capacity * 2 : S32;
+    PendingExpression *items = realloc(pending->items, new_capacity * sizeof *items);
+    if (!items) {
+      perror("assembler allocation failed");
+      exit(1);
+    }
+    pending->items = items;
+    pending->capacity = new_capacity;
+  }
+  PendingExpression *item = &pending->items[pending->count++];
+  item->offset = (uint32_t)offset;
+  item->lineNumber = parser->lineNumber;
+  item->expressionPos = parser->expressionPos;
+  item->instruction = strdup(parser->currentInstruction);
+  if (!item->instruction) {
+    perror("assembler allocation failed");
+    exit(1);
+  }
+}
+
+static void free_pending_expressions(PendingExpressions *pending) {
+  for (size_t i = 0; i < pending->count; i++) {
+    free(pending->items[i].instruction);
+  }
+  FREE(pending->items);
+}
+
+// a module can never be linked into more than the ROM holds, so assembly stops there.
+// this bounds the code (and the pending expressions) by the ROM size, labels and .equ
+// constants still take memory for each one defined before that point
+static bool check_rom_size(const Module *module, const Parser *parser) {
+  if (module->codeCount <= ROM_SIZE) {
+    return true;
+  }
+  fprintf(stderr, "[ERROR] %s doesn't fit in the %d word ROM, line %d is past the end\n", module->name, ROM_SIZE,
+          parser->lineNumber);
+  return false;
+}
+
+// evaluates an expression and reports any error at its column. returns false on error
+static bool evaluate(const Module *module, bool final, const char *instruction, const char *type, int line_number,
+                     int expression_pos, ExprValue *value) {
+  const char *expression = instruction + expression_pos;
+  char message[S128];
+  const char *error = evaluate_expression(expression, module, final, value, message, sizeof message);
+  if (error) {
+    print_syntax_error(instruction, type, line_number, expression_pos + (int)(error - expression), "%s", message);
+    return false;
+  }
+  if (value->kind == EXPR_ABSOLUTE && (value->value < 0 || value->value > MAX_CONSTANT_SIZE)) {
+    print_syntax_error(instruction, type, line_number, expression_pos, "expression value %d is outside 0..%d",
+                       value->value, MAX_CONSTANT_SIZE);
+    return false;
+  }
+  return true;
+}
+
+// stores an evaluated expression in the A-instruction at offset, relocated if it's an address
+static void patch_expression(Module *module, size_t offset, const ExprValue *value) {
+  module->code[offset] = (uint16_t)value->value;
+  if (value->kind == EXPR_ROM) {
+    module_relocate(module, offset, nullptr);
+  } else if (value->kind == EXPR_EXTERN) {
+    module_relocate(module, offset, value->symbol);
+  }
+}
+
+static bool resolve_pending_expressions(Module *module, const PendingExpressions *pending) {
+  bool ok = true;
+  for (size_t i = 0; i < pending->count; i++) {
+    const PendingExpression *item = &pending->items[i];
+    ExprValue value;
+    if (evaluate(module, true, item->instruction, "A-instruction", item->lineNumber, item->expressionPos, &value)) {
+      patch_expression(module, item->offset, &value);
+    } else {
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+static void define_constant(Module *module, Parser *parser) {
+  ExprValue value;
+  if (!evaluate(module, false, parser->currentInstruction, parser->typeString, parser->lineNumber,
+                parser->expressionPos, &value)) {
+    parser->errorStatus = true;
+    return;
+  }
+  if (value.kind == EXPR_UNRESOLVED) {
+    print_syntax_error(parser->currentInstruction, parser->typeString, parser->lineNumber, parser->expressionPos,
+                       "value must only use constants and labels defined above");
+    parser->errorStatus = true;
+  } else if (value.kind != EXPR_ABSOLUTE) {
+    print_syntax_error(parser->currentInstruction, parser->typeString, parser->lineNumber, parser->expressionPos,
+                       "value can't be the address of \'%s\'", value.symbol);
+    parser->errorStatus = true;
+  } else if (lookup_predefined_symbol(parser->symbol, &(int){0}) || contains(&module->labels, parser->symbol) ||
+             !module_define_constant(module, parser->symbol, value.value)) {
+    int name_pos = (int)(strstr(parser->currentInstruction + 4, parser->symbol) - parser->currentInstruction);
+    print_syntax_error(parser->currentInstruction, parser->typeString, parser->lineNumber, name_pos,
+                       "\'%s\' is already defined", parser->symbol);
+    parser->errorStatus = true;
+  }
+}
+
+// every .global has to name a label of the module
+static bool check_exports(const char *filename, const Module *module) {
+  bool ok = true;
+  for (size_t i = 0; i < module->exports.capacity; i++) {
+    const Symbol *export = &module->exports.entries[i];
+    if (export->name && !contains(&module->labels, export->name)) {
+      fprintf(stderr, "[ERROR] %s: .global '%s' on line %d is not a label of this file\n", filename, export->name,
+              export->address);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// assembles one .asm file into a relocatable module, returns false on any syntax error
+bool assemble_file(const char *filename, Module *module) {
+  Parser p;
+  Parser *parser = &p;
+  TranslatedCode c;
+  TranslatedCode *code = &c;
+  parser_init(parser, filename);
+  if (!parser->inputFile) {
+    return false;
+  }
+  reset_fields(parser, code);
+  PendingExpressions pending = {nullptr, 0, 0};
+  InstructionCache cache;
+  instruction_cache_init(&cache);
+
+  bool has_errors = false;
+  while (advance(parser)) {
+    if (!has_more_lines(parser))
+      break;
+    const CacheEntry *cached =
+        parser->errorStatus ? nullptr : instruction_cache_lookup(&cache, parser->currentInstruction);
+    if (cached) {
+      // seen before and valid, skip parsing and table lookups
+      if (!has_errors) {
+        if (cached->kind == CACHED_EXTERN) {
+          module_emit_extern(module, cached->value);
+        } else {
+          module_emit(module, (uint16_t)cached->value);
+        }
+        if (!check_rom_size(module, parser)) {
+          has_errors = true;
+          break;
+        }
+      }
+      continue;
+    }
+    instruction_type(parser);
+
+    if (parser->type == A_INSTRUCTION || parser->type == L_INSTRUCTION) {
+      get_symbol(parser);
+    } else if (parser->type == DIRECTIVE) {
+      parse_directive(parser);
+    } else {
+      parse_c_instruction(parser, code);
+    }
+    if (parser->type == L_INSTRUCTION && !parser->errorStatus &&
+        (contains(&module->constants, parser->symbol) || !module_define_label(module, parser->symbol))) {
+      print_syntax_error(parser->currentInstruction, parser->typeString, parser->lineNumber, 1,
+                         "duplicate label \'%s\'", parser->symbol);
+      parser->errorStatus = true;
+    }
+    if (parser->type == DIRECTIVE && !parser->errorStatus) {
+      if (parser->isExpression) {
+        define_constant(module, parser);
+      } else {
+        module_export(module, parser->symbol, parser->lineNumber);
+      }
+    }
+    if (parser->type == A_INSTRUCTION && parser->isExpression && !parser->errorStatus) {
+      ExprValue value;
+      if (!evaluate(module, false, parser->currentInstruction, parser->typeString, parser->lineNumber,
+                    parser->expressionPos, &value)) {
+        parser->errorStatus = true;
+      } else if (!has_errors) {
+        module_emit(module, 0);
+        if (value.kind == EXPR_UNRESOLVED) {
+          defer_expression(&pending, parser, module->codeCount - 1);
+        } else {
+          patch_expression(module, module->codeCount - 1, &value);
+        }
+      }
+    }
+    if (parser->errorStatus) {
+      has_errors = true;
+      reset_fields(parser, code);
+      continue;
+    }
+    print_debug(dbg, "successfully parsed %s on line %d\n", parser->currentInstruction, parser->lineNumber);
+    if (!has_errors && !parser->isExpression) {
+      int address;
+      if (parser->type == A_INSTRUCTION && !parser->isConstant) {
+        if (lookup_predefined_symbol(parser->symbol, &address)) {
+          module_emit(module, (uint16_t)address);
+          instruction_cache_insert(&cache, parser->currentInstruction, CACHED_WORD, (uint32_t)address);
+        } else {
+          uint32_t index = module_emit_reference(module, parser->symbol);
+          instruction_cache_insert(&cache, parser->currentInstruction, CACHED_EXTERN, index);
+        }
+      } else if (parser->type == A_INSTRUCTION || parser->type == C_INTRUCTION) {
+        uint16_t word = assemble_bits(parser, code);
+        module_emit(module, word);
+        instruction_cache_insert(&cache, parser->currentInstruction, CACHED_WORD, word);
+      }
+    }
+    if (!has_errors && !check_rom_size(module, parser)) {
+      has_errors = true;
+      break;
+    }
+    reset_fields(parser, code);
+  }
+  parser_destroy(parser);
+  if (cache_options.printStats || dbg->enabled) {
+    instruction_cache_print_stats(&cache, filename);
+  }
+  instruction_cache_destroy(&cache);
+
+  if (!has_errors) {
+    has_errors = !resolve_pending_expressions(module, &pending);
+  }
+  free_pending_expressions(&pending);
+  if (!has_errors) {
+    has_errors = !check_exports(filename, module);
+  }
+  if (!has_errors) {
+    module_finalize(module);
+  }
+  return !has_errors;
+}
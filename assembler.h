@@ -0,0 +1,5 @@
+#pragma once
+
+#include "module.h"
+
+bool assemble_file(const char *filename, Module *module);
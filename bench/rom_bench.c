@@ -0,0 +1,254 @@
+// Compression ratio and encode/decode throughput of the .hrom LZ payload, with a round trip check.
+//
+// build and run from the repository root:
+//   cc -std=c2x -O2 -o rom_bench bench/rom_bench.c rom.c helper.c strlib.c && ./rom_bench
+// add -g -fsanitize=address,undefined to also check that corrupt payloads never overrun.
+//
+// The corpus is generated: ROMs of 2K to 30K words built from the instruction sequences the VM
+// translator emits (push/pop of every segment kind, arithmetic, comparisons, call and return),
+// with operands, static addresses and jump targets drawn from a fixed seed.
+#include "../rom.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum { SP = 0, LCL = 1, ARG = 2, THIS = 3, THAT = 4, R13 = 13, R14 = 14, FIRST_STATIC = 16 };
+enum { BYTES_PER_TEXT_WORD = 17, ROM_HEADER_BYTES = 16, WORDS_PER_RUN = 1 << 22 };
+
+#define C(a, comp, dest, jump) ((uint16_t)(0xE000 | (a) << 12 | (comp) << 6 | (dest) << 3 | (jump)))
+enum {
+  D_A = C(0, 0b110000, 0b010, 0),
+  D_M = C(1, 0b110000, 0b010, 0),
+  A_M = C(1, 0b110000, 0b100, 0),
+  M_D = C(0, 0b001100, 0b001, 0),
+  M_0 = C(0, 0b101010, 0b001, 0),
+  M_MINUS_1 = C(0, 0b111010, 0b001, 0),
+  AM_M_PLUS_1 = C(1, 0b110111, 0b101, 0),
+  AM_M_MINUS_1 = C(1, 0b110010, 0b101, 0),
+  A_A_MINUS_1 = C(0, 0b110010, 0b100, 0),
+  A_M_MINUS_1 = C(1, 0b110010, 0b100, 0),
+  A_D_PLUS_M = C(1, 0b000010, 0b100, 0),
+  D_D_PLUS_M = C(1, 0b000010, 0b010, 0),
+  D_D_MINUS_A = C(0, 0b010011, 0b010, 0),
+  A_D_MINUS_A = C(0, 0b010011, 0b100, 0),
+  D_M_PLUS_1 = C(1, 0b110111, 0b010, 0),
+  D_M_MINUS_D = C(1, 0b000111, 0b010, 0),
+  M_D_PLUS_M = C(1, 0b000010, 0b001, 0),
+  M_M_MINUS_D = C(1, 0b000111, 0b001, 0),
+  M_D_AND_M = C(1, 0b000000, 0b001, 0),
+  M_NOT_M = C(1, 0b110001, 0b001, 0),
+  D_JEQ = C(0, 0b001100, 0b000, 0b010),
+  D_JNE = C(0, 0b001100, 0b000, 0b101),
+  JMP = C(0, 0b101010, 0b000, 0b111),
+};
+#undef C
+
+typedef struct {
+  uint16_t *words;
+  size_t count;
+  size_t size;
+  uint32_t seed;
+} Program;
+
+static uint32_t next_random(Program *p) {
+  p->seed ^= p->seed << 13;
+  p->seed ^= p->seed >> 17;
+  p->seed ^= p->seed << 5;
+  return p->seed;
+}
+
+static void emit(Program *p, size_t count, const uint16_t *words) {
+  for (size_t i = 0; i < count && p->count < p->size; i++)
+    p->words[p->count++] = words[i];
+}
+
+#define EMIT(p, ...) emit(p, sizeof((uint16_t[]){__VA_ARGS__}) / sizeof(uint16_t), (uint16_t[]){__VA_ARGS__})
+
+static void push_d(Program *p) { EMIT(p, SP, AM_M_PLUS_1, A_A_MINUS_1, M_D); }
+
+static void pop_d(Program *p) { EMIT(p, SP, AM_M_MINUS_1, D_M); }
+
+static void emit_command(Program *p, uint16_t functions[], size_t function_count) {
+  static const uint16_t bases[] = {LCL, ARG, THIS, THAT};
+  uint16_t here = (uint16_t)p->count;
+  uint32_t r = next_random(p);
+  uint16_t small = (uint16_t)(r >> 8 & 7);
+  switch (r % 10) {
+  case 0:
+  case 1:
+  case 2: // push constant
+    EMIT(p, (uint16_t)(r >> 8 & 0x7F), D_A);
+    push_d(p);
+    break;
+  case 3: // push local/argument/this/that
+    EMIT(p, small, D_A, bases[r >> 12 & 3], A_D_PLUS_M, D_M);
+    push_d(p);
+    break;
+  case 4: // pop local/argument/this/that
+    EMIT(p, small, D_A, bases[r >> 12 & 3], D_D_PLUS_M, R13, M_D);
+    pop_d(p);
+    EMIT(p, R13, A_M, M_D);
+    break;
+  case 5: // push/pop static
+    if (r & 0x10000) {
+      EMIT(p, (uint16_t)(FIRST_STATIC + small), D_M);
+      push_d(p);
+    } else {
+      pop_d(p);
+      EMIT(p, (uint16_t)(FIRST_STATIC + small), M_D);
+    }
+    break;
+  case 6: { // add/sub/and, not
+    static const uint16_t binary[] = {M_D_PLUS_M, M_M_MINUS_D, M_D_AND_M};
+    if (small == 7) {
+      EMIT(p, SP, A_M_MINUS_1, M_NOT_M);
+    } else {
+      pop_d(p);
+      EMIT(p, A_A_MINUS_1, binary[small % 3]);
+    }
+    break;
+  }
+  case 7: // eq/lt/gt, the jump target is a patched ROM address
+    pop_d(p);
+    EMIT(p, A_A_MINUS_1, D_M_MINUS_D, M_MINUS_1, (uint16_t)(here + 10), D_JEQ, SP, A_M_MINUS_1, M_0);
+    break;
+  case 8: { // call
+    EMIT(p, (uint16_t)(here + 45), D_A);
+    push_d(p);
+    for (size_t i = 0; i < 4; i++) {
+      EMIT(p, bases[i], D_M);
+      push_d(p);
+    }
+    EMIT(p, SP, D_M, (uint16_t)(5 + small % 3), D_D_MINUS_A, ARG, M_D, SP, D_M, LCL, M_D,
+         functions[r >> 16 & (function_count - 1)], JMP);
+    break;
+  }
+  case 9: // if-goto inside the function
+    pop_d(p);
+    EMIT(p, (uint16_t)(here + (r >> 8 & 0x3F)), D_JNE);
+    break;
+  }
+}
+
+// the same sequence as translate_return in vm.c
+static void emit_return(Program *p) {
+  static const uint16_t restored[] = {THAT, THIS, ARG, LCL};
+  EMIT(p, LCL, D_M, R13, M_D, 5, A_D_MINUS_A, D_M, R14, M_D);
+  pop_d(p);
+  EMIT(p, ARG, A_M, M_D, ARG, D_M_PLUS_1, SP, M_D);
+  for (size_t i = 0; i < 4; i++)
+    EMIT(p, R13, AM_M_MINUS_1, D_M, restored[i], M_D);
+  EMIT(p, R14, A_M, JMP);
+}
+
+static void generate(Program *p, size_t size, uint32_t seed) {
+  p->words = malloc(size * sizeof *p->words);
+  if (!p->words) {
+    perror("benchmark allocation failed");
+    exit(1);
+  }
+  p->count = 0;
+  p->size = size;
+  p->seed = seed;
+  uint16_t functions[16];
+  for (size_t i = 0; i < 16; i++)
+    functions[i] = (uint16_t)(next_random(p) % size);
+  while (p->count < size) {
+    uint32_t locals = next_random(p) % 4;
+    for (uint32_t i = 0; i < locals; i++) {
+      EMIT(p, SP, AM_M_PLUS_1, A_A_MINUS_1, M_0);
+    }
+    uint32_t commands = 20 + next_random(p) % 60;
+    for (uint32_t i = 0; i < commands; i++)
+      emit_command(p, functions, 16);
+    emit_return(p);
+  }
+}
+
+static double seconds(void) {
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+// a payload cut short must always be rejected, a flipped byte may decode to other words but must
+// stay inside the buffers. returns the number of cut payloads that were wrongly accepted
+static size_t check_corrupt_payloads(const uint8_t *payload, size_t payload_size, size_t words, Program *p) {
+  uint8_t *copy = malloc(payload_size ? payload_size : 1);
+  uint16_t *out = malloc(words * sizeof *out);
+  if (!copy || !out) {
+    perror("benchmark allocation failed");
+    exit(1);
+  }
+  size_t accepted = 0;
+  for (int i = 0; i < 1000; i++) {
+    size_t cut = next_random(p) % payload_size;
+    if (rom_decompress(payload, cut, out, words))
+      accepted++;
+    memcpy(copy, payload, payload_size);
+    copy[next_random(p) % payload_size] ^= (uint8_t)(1 + next_random(p) % 255);
+    rom_decompress(copy, payload_size, out, words);
+  }
+  free(copy);
+  free(out);
+  return accepted;
+}
+
+int main(void) {
+  static const size_t sizes[] = {2048, 4096, 6144, 8192, 12288, 16384, 24576, 30720};
+  size_t total_words = 0, total_payload = 0;
+  double total_encode = 0, total_decode = 0;
+  bool ok = true;
+
+  printf("%8s %10s %9s %10s %12s %12s\n", "words", "payload", "vs raw", "vs .hack", "encode MB/s", "decode MB/s");
+  for (size_t s = 0; s < sizeof sizes / sizeof sizes[0]; s++) {
+    Program program;
+    generate(&program, sizes[s], 0x9E3779B9u + (uint32_t)s);
+    size_t words = program.count;
+    uint8_t *payload = malloc(rom_compress_bound(words));
+    uint16_t *decoded = malloc(words * sizeof *decoded);
+    if (!payload || !decoded) {
+      perror("benchmark allocation failed");
+      exit(1);
+    }
+
+    size_t runs = WORDS_PER_RUN / words + 1, payload_size = 0;
+    double start = seconds();
+    for (size_t r = 0; r < runs; r++)
+      payload_size = rom_compress(program.words, words, payload);
+    double encode = seconds() - start;
+
+    start = seconds();
+    for (size_t r = 0; r < runs; r++)
+      ok = rom_decompress(payload, payload_size, decoded, words) && ok;
+    double decode = seconds() - start;
+    if (!ok || memcmp(decoded, program.words, words * sizeof *decoded) != 0) {
+      fprintf(stderr, "[ERROR] %zu word ROM doesn't survive the round trip\n", words);
+      ok = false;
+    }
+    size_t accepted = check_corrupt_payloads(payload, payload_size, words, &program);
+    if (accepted) {
+      fprintf(stderr, "[ERROR] %zu truncated payloads of the %zu word ROM were accepted\n", accepted, words);
+      ok = false;
+    }
+
+    double raw_bytes = (double)(words * 2 * runs);
+    printf("%8zu %10zu %8.2fx %9.2fx %12.0f %12.0f\n", words, payload_size, (double)(words * 2) / (double)payload_size,
+           (double)(words * BYTES_PER_TEXT_WORD) / (double)(payload_size + ROM_HEADER_BYTES), raw_bytes / encode / 1e6,
+           raw_bytes / decode / 1e6);
+    total_words += words * runs;
+    total_payload += payload_size * runs;
+    total_encode += encode;
+    total_decode += decode;
+    free(payload);
+    free(decoded);
+    free(program.words);
+  }
+  printf("total: %.2fx vs raw words, encode %.0f MB/s, decode %.0f MB/s of raw words\n",
+         (double)(total_words * 2) / (double)total_payload, (double)(total_words * 2) / total_encode / 1e6,
+         (double)(total_words * 2) / total_decode / 1e6);
+  puts(ok ? "round trip ok" : "round trip FAILED");
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
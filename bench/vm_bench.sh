@@ -0,0 +1,86 @@
+#!/usr/bin/env bash
+# Direct .vm translation against the two-step text pipeline.
+#
+# usage, from the repository root:
+#   cc -std=c2x -O2 -o hack *.c && bench/vm_bench.sh ./hack [copies]
+#
+# Generates a fixed ~2.6K-command .vm file (10 functions of push/pop, arithmetic, comparisons,
+# label/goto/if-goto, call and return) and times `hack -c` on `copies` (default 100) copies of it.
+# For the text pipeline the same program is written out as .asm: the direct translation is
+# linked and disassembled, which also checks that assembling that text gives back the same words.
+# The .asm uses plain addresses and no labels, the cheapest text a VM translator could produce,
+# and the time to produce it isn't counted, so the two-step figure is a lower bound.
+set -euo pipefail
+
+hack=${1:-./hack}
+copies=${2:-100}
+[ -x "$hack" ] || { echo "usage: $0 <path to hack> [copies]" >&2; exit 1; }
+hack=$(cd "$(dirname "$hack")" && pwd)/$(basename "$hack")
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+
+# the same numbers with any awk: Park-Miller instead of rand(), exact in double precision
+awk 'function rnd(n) { seed = (seed * 16807) % 2147483647; return int(seed / 1024) % n }
+BEGIN {
+  seed = 1
+  split("add sub neg not and or eq lt gt", ops, " ")
+  split("local argument this that", segments, " ")
+  for (f = 0; f < 10; f++) {
+    printf "function F%d.run 2\n", f
+    print "label TOP"
+    for (i = 0; i < 258; i++) {
+      r = rnd(20)
+      if (r < 6) printf "push constant %d\n", rnd(100)
+      else if (r < 9) printf "push %s %d\n", segments[rnd(4) + 1], rnd(2)
+      else if (r < 11) printf "pop %s %d\n", segments[rnd(4) + 1], rnd(2)
+      else if (r < 12) printf "push static %d\n", rnd(8)
+      else if (r < 13) printf "pop static %d\n", rnd(8)
+      else if (r < 17) print ops[rnd(9) + 1]
+      else if (r < 18) print (rnd(2) ? "if-goto TOP" : "goto END")
+      else if (r < 19) printf "push temp %d\n", rnd(8)
+      else printf "call F%d.run 1\n", rnd(10)
+    }
+    print "label END"
+    print "return"
+  }
+}' > Bench.vm
+
+# Hack machine code back to assembly, with the parser's own mnemonic spellings
+"$hack" -o Bench.hack Bench.vm > /dev/null 2>&1
+awk 'BEGIN {
+  split("0101010 0 0111111 1 0111010 -1 0001100 D 0110000 A 1110000 M 0001101 !D 0110001 !A 1110001 !M " \
+        "0001111 -D 0110011 -A 1110011 -M 0011111 D+1 0110111 A+1 1110111 M+1 0001110 D-1 0110010 A-1 " \
+        "1110010 M-1 0000010 D+A 1000010 D+M 0010011 D-A 1010011 D-M 0000111 A-D 1000111 M-D " \
+        "0000000 D&A 1000000 D&M 0010101 D|A 1010101 D|M", c, " ")
+  for (i = 1; i < 56; i += 2) comp[c[i]] = c[i + 1]
+  split("001 M 010 D 011 DM 100 A 101 AM 110 AD 111 ADM", d, " ")
+  for (i = 1; i < 14; i += 2) dest[d[i]] = d[i + 1] "="
+  split("001 JGT 010 JEQ 011 JGE 100 JLT 101 JNE 110 JLE 111 JMP", j, " ")
+  for (i = 1; i < 14; i += 2) jump[j[i]] = ";" j[i + 1]
+}
+{
+  sub(/\r$/, "")
+  if (substr($0, 1, 1) == "0") {
+    value = 0
+    for (i = 2; i <= 16; i++) value = value * 2 + substr($0, i, 1)
+    print "@" value
+  } else {
+    print dest[substr($0, 11, 3)] comp[substr($0, 4, 7)] jump[substr($0, 14, 3)]
+  }
+}' Bench.hack > Bench.asm
+"$hack" -o Check.hack Bench.asm > /dev/null 2>&1
+cmp -s Bench.hack Check.hack || { echo "disassembled Bench.asm doesn't assemble back to Bench.hack" >&2; exit 1; }
+
+for i in $(seq "$copies"); do
+  cp Bench.vm "V$i.vm"
+  cp Bench.asm "A$i.asm"
+done
+
+echo "$(grep -c . Bench.vm) commands, $(wc -l < Bench.hack | tr -d ' ') words, $copies copies"
+TIMEFORMAT='%R s'
+echo -n "direct .vm -> .hobj:      "
+time "$hack" -c V*.vm > /dev/null 2>&1
+echo -n "assemble .asm -> .hobj:   "
+time "$hack" -c A*.asm > /dev/null 2>&1
@@ -0,0 +1,75 @@
+#include "cache.h"
+#include "helper.h"
+#include "symbol.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static_assert(sizeof(CacheEntry) == 64, "a cache entry should fill exactly one cache line");
+static_assert((INSTRUCTION_CACHE_SIZE & (INSTRUCTION_CACHE_SIZE - 1)) == 0, "cache size must be a power of two");
+
+CacheOptions cache_options = {.enabled = true, .printStats = false};
+
+void instruction_cache_init(InstructionCache *cache) {
+  cache->hits = 0;
+  cache->misses = 0;
+  if (!cache_options.enabled) {
+    cache->entries = nullptr;
+    return;
+  }
+  cache->entries = aligned_alloc(alignof(CacheEntry), INSTRUCTION_CACHE_SIZE * sizeof *cache->entries);
+  if (!cache->entries) {
+    perror("instruction cache allocation failed");
+    exit(1);
+  }
+  memset(cache->entries, 0, INSTRUCTION_CACHE_SIZE * sizeof *cache->entries);
+}
+
+void instruction_cache_destroy(InstructionCache *cache) {
+  if (!cache)
+    return;
+  FREE(cache->entries);
+}
+
+// printed with --cache-stats, or in debug mode
+void instruction_cache_print_stats(const InstructionCache *cache, const char *filename) {
+  if (!cache->entries) {
+    fprintf(stderr, "%s: instruction cache disabled\n", filename);
+    return;
+  }
+  size_t lookups = cache->hits + cache->misses;
+  fprintf(stderr, "%s: instruction cache %zu hits, %zu misses (%.1f%% hit rate)\n", filename, cache->hits,
+          cache->misses, lookups ? 100.0 * (double)cache->hits / (double)lookups : 0.0);
+}
+
+// returns nullptr on a miss, and always when the cache is disabled
+const CacheEntry *instruction_cache_lookup(InstructionCache *cache, const char *instruction) {
+  if (!cache->entries) {
+    return nullptr;
+  }
+  size_t length = strlen(instruction);
+  uint32_t hash = hash_symbol(instruction);
+  const CacheEntry *entry = &cache->entries[hash & (INSTRUCTION_CACHE_SIZE - 1)];
+  if (entry->length == length && entry->hash == hash && memcmp(entry->key, instruction, length) == 0) {
+    cache->hits++;
+    return entry;
+  }
+  cache->misses++;
+  return nullptr;
+}
+
+// lines too long for a key are simply not cached
+void instruction_cache_insert(InstructionCache *cache, const char *instruction, CachedKind kind, uint32_t value) {
+  size_t length = strlen(instruction);
+  if (!cache->entries || length == 0 || length > sizeof cache->entries[0].key) {
+    return;
+  }
+  uint32_t hash = hash_symbol(instruction);
+  CacheEntry *entry = &cache->entries[hash & (INSTRUCTION_CACHE_SIZE - 1)];
+  entry->hash = hash;
+  entry->value = value;
+  entry->length = (uint8_t)length;
+  entry->kind = (uint8_t)kind;
+  memcpy(entry->key, instruction, length);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Generated Hack code repeats the same few lines (@SP, AM=M+1, D=M...) over and over, so the
+// assembler remembers what each trimmed source line encoded to and skips parsing on a hit
+enum { INSTRUCTION_CACHE_SIZE = 1024, INSTRUCTION_CACHE_KEY_SIZE = 54 };
+
+typedef enum { CACHED_WORD, CACHED_EXTERN } CachedKind;
+
+typedef struct {
+  alignas(64) uint32_t hash;
+  uint32_t value; // the encoded word, or the extern index of an A-instruction symbol
+  uint8_t length; // 0 marks an empty entry
+  uint8_t kind;
+  char key[INSTRUCTION_CACHE_KEY_SIZE];
+} CacheEntry;
+
+typedef struct {
+  CacheEntry *entries; // direct-mapped, a new line evicts whatever was in its slot, nullptr when disabled
+  size_t hits;
+  size_t misses;
+} InstructionCache;
+
+// set from the command line, --no-cache and --cache-stats
+typedef struct {
+  bool enabled;
+  bool printStats;
+} CacheOptions;
+
+extern CacheOptions cache_options;
+
+void instruction_cache_init(InstructionCache *cache);
+void instruction_cache_destroy(InstructionCache *cache);
+void instruction_cache_print_stats(const InstructionCache *cache, const char *filename);
+const CacheEntry *instruction_cache_lookup(InstructionCache *cache, const char *instruction);
+void instruction_cache_insert(InstructionCache *cache, const char *instruction, CachedKind kind, uint32_t value);
@@ -1,6 +1,8 @@
 #include "code.h"
 #include "helper.h"
 #include "parser.h"
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 void get_dest_code(Parser *parser, TranslatedCode *code) {
@@ -52,3 +54,17 @@ void get_jump_code(Parser *parser, TranslatedCode *code) {
     snprintf(code->jump, sizeof code->comp, "%s", binary);
   }
 }
+
+// encodes a C-instruction from its mnemonics with the same tables the parser uses,
+// returns false if any mnemonic is unknown
+bool encode_c_instruction(const char *dest, const char *comp, const char *jump, uint16_t *word) {
+  const char *dest_bits = lookup_mnemonic(dest_table, dest);
+  const char *comp_bits = lookup_mnemonic(comp_table, comp);
+  const char *jump_bits = lookup_mnemonic(jump_table, jump);
+  if (!dest_bits || !comp_bits || !jump_bits) {
+    return false;
+  }
+  *word = (uint16_t)(0xE000 | strtol(comp_bits, nullptr, 2) << 6 | strtol(dest_bits, nullptr, 2) << 3 |
+                     strtol(jump_bits, nullptr, 2));
+  return true;
+}
@@ -2,7 +2,9 @@
 
 #include "parser.h"
 #include "types.h"
+#include <stdint.h>
 
 void get_dest_code(Parser *parser, TranslatedCode *code);
 void get_comp_code(Parser *parser, TranslatedCode *code);
 void get_jump_code(Parser *parser, TranslatedCode *code);
+bool encode_c_instruction(const char *dest, const char *comp, const char *jump, uint16_t *word);
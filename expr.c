@@ -0,0 +1,291 @@
+#include "expr.h"
+#include "helper.h"
+#include "module.h"
+#include "symbol.h"
+#include "types.h"
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// A-instruction and .equ expressions, C operator precedence from loosest to tightest:
+//   |   ^   &   << >>   + -   * / %   unary -   ( )
+// intermediate values must fit in 16 bits, the caller range-checks the final value
+
+enum { EXPR_LIMIT = 65535, EXPR_LEVELS = 6 };
+
+typedef struct {
+  const char *cursor;
+  const Module *module;
+  bool final;        // unknown symbols are externs rather than not defined yet
+  const char *error; // offending char of the first error, nullptr while ok
+  char *message;
+  size_t messageSize;
+} ExprParser;
+
+static void fail(ExprParser *ep, const char *at, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+static void fail(ExprParser *ep, const char *at, const char *format, ...) {
+  if (ep->error)
+    return;
+  ep->error = at;
+  va_list args;
+  va_start(args, format);
+  vsnprintf(ep->message, ep->messageSize, format, args);
+  va_end(args);
+}
+
+static void skip_spaces(ExprParser *ep) {
+  while (isspace((unsigned char)*ep->cursor))
+    ep->cursor++;
+}
+
+static bool is_symbol_char(int c) { return isalnum(c) || c == '_' || c == '.' || c == '$' || c == ':'; }
+
+bool is_expression(const char *string) { return strpbrk(string, "+-*/%()<>&|^ \t") != nullptr; }
+
+// returns the operator's length or 0 if the cursor isn't on an operator of that precedence level
+static int match_operator(const char *c, int level, char *op) {
+  static const char *operators[EXPR_LEVELS] = {"|", "^", "&", "<>", "+-", "*/%"};
+  if (level == 3) {
+    if ((c[0] == '<' || c[0] == '>') && c[1] == c[0]) {
+      *op = c[0];
+      return 2;
+    }
+    return 0;
+  }
+  if (*c && strchr(operators[level], *c)) {
+    *op = *c;
+    return 1;
+  }
+  return 0;
+}
+
+static const char *operator_name(char op) {
+  switch (op) {
+  case '<':
+    return "<<";
+  case '>':
+    return ">>";
+  case '|':
+    return "|";
+  case '^':
+    return "^";
+  case '&':
+    return "&";
+  case '+':
+    return "+";
+  case '-':
+    return "-";
+  case '*':
+    return "*";
+  case '/':
+    return "/";
+  default:
+    return "%";
+  }
+}
+
+static void parse_level(ExprParser *ep, int level, ExprValue *out);
+
+static void parse_symbol(ExprParser *ep, ExprValue *out) {
+  const char *start = ep->cursor;
+  while (is_symbol_char((unsigned char)*ep->cursor))
+    ep->cursor++;
+  if (ep->cursor - start >= (ptrdiff_t)sizeof out->symbol) {
+    fail(ep, start, "symbol is longer than %d characters", (int)sizeof out->symbol - 1);
+    return;
+  }
+  snprintf(out->symbol, sizeof out->symbol, "%.*s", (int)(ep->cursor - start), start);
+
+  int address = get_address(&ep->module->constants, out->symbol);
+  if (address >= 0 || lookup_predefined_symbol(out->symbol, &address)) {
+    out->kind = EXPR_ABSOLUTE;
+    out->value = address;
+  } else if ((address = get_address(&ep->module->labels, out->symbol)) >= 0) {
+    out->kind = EXPR_ROM;
+    out->value = address;
+  } else {
+    out->kind = ep->final ? EXPR_EXTERN : EXPR_UNRESOLVED;
+    out->value = 0;
+  }
+}
+
+static void parse_number(ExprParser *ep, ExprValue *out) {
+  const char *start = ep->cursor;
+  while (isalnum((unsigned char)*ep->cursor))
+    ep->cursor++;
+  char literal[S64];
+  snprintf(literal, sizeof literal, "%.*s", (int)(ep->cursor - start), start);
+
+  const char *bad_char = nullptr;
+  out->kind = EXPR_ABSOLUTE;
+  out->value = 0;
+  switch (parse_literal(literal, &out->value, &bad_char)) {
+  case LITERAL_OK:
+  case LITERAL_NONE:
+    break;
+  case LITERAL_BAD_DIGIT:
+    fail(ep, start + (bad_char - literal), "invalid digit \'%c\' in constant", *bad_char);
+    break;
+  case LITERAL_MISSING_DIGITS:
+    fail(ep, start + (bad_char - literal), "missing digits after \'%.2s\'", literal);
+    break;
+  case LITERAL_OVERFLOW:
+    fail(ep, start, "constant is larger than %d", MAX_CONSTANT_SIZE);
+    break;
+  }
+}
+
+static void parse_primary(ExprParser *ep, ExprValue *out) {
+  skip_spaces(ep);
+  const char *start = ep->cursor;
+  out->kind = EXPR_ABSOLUTE;
+  out->value = 0;
+  out->symbol[0] = '\0';
+
+  if (*start == '(') {
+    ep->cursor++;
+    parse_level(ep, 0, out);
+    skip_spaces(ep);
+    if (*ep->cursor != ')') {
+      fail(ep, ep->cursor, "missing \')\'");
+      return;
+    }
+    ep->cursor++;
+  } else if (*start == '-') {
+    ep->cursor++;
+    parse_primary(ep, out);
+    if (out->kind == EXPR_ROM || out->kind == EXPR_EXTERN) {
+      fail(ep, start, "can't negate the address of \'%s\'", out->symbol);
+    }
+    out->value = -out->value;
+  } else if (isdigit((unsigned char)*start)) {
+    parse_number(ep, out);
+  } else if (is_symbol_char((unsigned char)*start)) {
+    parse_symbol(ep, out);
+  } else if (*start) {
+    fail(ep, start, "unexpected \'%c\'", *start);
+  } else {
+    fail(ep, start, "missing operand");
+  }
+}
+
+static void combine(ExprParser *ep, const char *op_pos, char op, ExprValue *lhs, const ExprValue *rhs) {
+  if (lhs->kind == EXPR_UNRESOLVED || rhs->kind == EXPR_UNRESOLVED) {
+    lhs->kind = EXPR_UNRESOLVED;
+    return;
+  }
+
+  if (lhs->kind != EXPR_ABSOLUTE || rhs->kind != EXPR_ABSOLUTE) {
+    // address arithmetic: address +- constant, constant + address, and the distance between two labels
+    if (op == '+' && lhs->kind == EXPR_ABSOLUTE) {
+      int addend = lhs->value;
+      *lhs = *rhs;
+      lhs->value += addend;
+    } else if ((op == '+' || op == '-') && rhs->kind == EXPR_ABSOLUTE) {
+      lhs->value += op == '+' ? rhs->value : -rhs->value;
+    } else if (op == '-' && lhs->kind == EXPR_ROM && rhs->kind == EXPR_ROM) {
+      lhs->kind = EXPR_ABSOLUTE;
+      lhs->value -= rhs->value;
+    } else {
+      const char *symbol = lhs->kind != EXPR_ABSOLUTE ? lhs->symbol : rhs->symbol;
+      fail(ep, op_pos, "can't apply \'%s\' to the address of \'%s\'", operator_name(op), symbol);
+      return;
+    }
+  } else {
+    long long a = lhs->value, b = rhs->value, value;
+    switch (op) {
+    case '|':
+      value = a | b;
+      break;
+    case '^':
+      value = a ^ b;
+      break;
+    case '&':
+      value = a & b;
+      break;
+    case '<':
+    case '>':
+      if (b < 0 || b > 15) {
+        fail(ep, op_pos, "shift count %lld is outside 0..15", b);
+        return;
+      }
+      value = op == '<' ? a * (1LL << b) : a >> b;
+      break;
+    case '+':
+      value = a + b;
+      break;
+    case '-':
+      value = a - b;
+      break;
+    case '*':
+      value = a * b;
+      break;
+    default: // '/' and '%'
+      if (b == 0) {
+        fail(ep, op_pos, "division by zero");
+        return;
+      }
+      value = op == '/' ? a / b : a % b;
+      break;
+    }
+    if (value > EXPR_LIMIT || value < -EXPR_LIMIT) {
+      fail(ep, op_pos, "\'%s\' overflows 16 bits", operator_name(op));
+      return;
+    }
+    lhs->value = (int)value;
+    return;
+  }
+
+  if (lhs->value > EXPR_LIMIT || lhs->value < -EXPR_LIMIT) {
+    fail(ep, op_pos, "\'%s\' overflows 16 bits", operator_name(op));
+  }
+}
+
+static void parse_level(ExprParser *ep, int level, ExprValue *out) {
+  if (level == EXPR_LEVELS) {
+    parse_primary(ep, out);
+    return;
+  }
+  parse_level(ep, level + 1, out);
+  while (!ep->error) {
+    skip_spaces(ep);
+    char op;
+    int len = match_operator(ep->cursor, level, &op);
+    if (!len)
+      return;
+    const char *op_pos = ep->cursor;
+    ep->cursor += len;
+    ExprValue rhs;
+    parse_level(ep, level + 1, &rhs);
+    if (ep->error)
+      return;
+    combine(ep, op_pos, op, out, &rhs);
+  }
+}
+
+// returns nullptr on success or a pointer to the offending char with the reason in message.
+// while the module is still being read (final == false) symbols that aren't defined yet make
+// the result EXPR_UNRESOLVED, so the expression can be evaluated again once all labels are known
+const char *evaluate_expression(const char *expression, const Module *module, bool final, ExprValue *result,
+                                char *message, size_t message_size) {
+  ExprParser ep = {
+      .cursor = expression,
+      .module = module,
+      .final = final,
+      .error = nullptr,
+      .message = message,
+      .messageSize = message_size,
+  };
+  parse_level(&ep, 0, result);
+  skip_spaces(&ep);
+  if (!ep.error && *ep.cursor) {
+    if (*ep.cursor == ')') {
+      fail(&ep, ep.cursor, "unmatched \')\'");
+    } else {
+      fail(&ep, ep.cursor, "unexpected \'%c\'", *ep.cursor);
+    }
+  }
+  return ep.error;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "module.h"
+#include "types.h"
+
+typedef enum {
+  EXPR_ABSOLUTE,  // a plain constant
+  EXPR_ROM,       // module-relative ROM address: one of the module's labels plus a constant
+  EXPR_EXTERN,    // a symbol outside the module plus a constant
+  EXPR_UNRESOLVED // depends on a symbol that isn't defined yet, only while the module is still being read
+} ExprKind;
+
+typedef struct {
+  ExprKind kind;
+  int value;         // the constant, or the address plus addend for EXPR_ROM, or the addend for EXPR_EXTERN
+  char symbol[SYMBOL_SIZE]; // EXPR_EXTERN only
+} ExprValue;
+
+bool is_expression(const char *string);
+const char *evaluate_expression(const char *expression, const Module *module, bool final, ExprValue *result,
+                                char *message, size_t message_size);
@@ -88,23 +88,62 @@ void print_syntax_error(const char *line, const char *type, int line_number, int
           get_color_for_fd(fileno(stderr), RESET));
 }
 
-bool is_constant(const char *c) {
-  while (*c) {
-    if (!isdigit((unsigned char)*c++))
-      return false;
+static int literal_digit_value(int c) {
+  if (isdigit(c))
+    return c - '0';
+  if (isxdigit(c))
+    return tolower(c) - 'a' + 10;
+  return -1;
+}
+
+// parses a decimal, 0x hex or 0b binary literal in a single pass.
+// returns LITERAL_NONE if the string doesn't start with a digit (i.e. it's a symbol),
+// on any other error *bad_char points to the offending char (or the end of the literal)
+LiteralStatus parse_literal(const char *literal, int *out, const char **bad_char) {
+  const char *c = literal;
+  if (!isdigit((unsigned char)*c))
+    return LITERAL_NONE;
+
+  int base = 10;
+  if (c[0] == '0' && (c[1] == 'x' || c[1] == 'X')) {
+    base = 16;
+    c += 2;
+  } else if (c[0] == '0' && (c[1] == 'b' || c[1] == 'B')) {
+    base = 2;
+    c += 2;
   }
-  return true;
+  if (!*c) {
+    *bad_char = c;
+    return LITERAL_MISSING_DIGITS;
+  }
+
+  int value = 0;
+  bool overflow = false;
+  for (; *c; c++) {
+    int digit = literal_digit_value((unsigned char)*c);
+    if (digit < 0 || digit >= base) {
+      *bad_char = c;
+      return LITERAL_BAD_DIGIT;
+    }
+    // keep scanning for bad digits after an overflow, but stop accumulating
+    if (!overflow) {
+      value = value * base + digit;
+      overflow = value > MAX_CONSTANT_SIZE;
+    }
+  }
+  if (overflow) {
+    *bad_char = literal;
+    return LITERAL_OVERFLOW;
+  }
+  *out = value;
+  return LITERAL_OK;
 }
 
 // returns nullptr if valid or the invalid symbol's pointer otherwise
-const char *is_not_valid_symbol(char *symbol, InstructionType type) {
-  bool is_constant_var = is_constant(symbol);
-  if (!is_constant_var && isdigit((unsigned char)*symbol)) {
+const char *is_not_valid_symbol(char *symbol) {
+  if (isdigit((unsigned char)*symbol)) {
     return symbol; // cant start with a digit
   }
-  if (is_constant_var && (type == L_INSTRUCTION || !is_valid_const_size(symbol))) {
-    return symbol;
-  }
   // print_debug(dbg, "checking string \'%s\'.. \n", symbol);
   while (*symbol) {
     int sym = (unsigned char)*symbol;
@@ -118,20 +157,6 @@ const char *is_not_valid_symbol(char *symbol, InstructionType type) {
   return nullptr;
 }
 
-bool is_valid_const_size(const char *string) {
-  int result = 0;
-  if (str_to_int(string, &result)) {
-    // print_debug(dbg, "converted %d\n", result);
-    if (result > MAX_CONSTANT_SIZE) {
-      return false;
-    }
-  } else {
-    printf("conversion to int failed\n");
-    exit(1);
-  }
-  return true;
-}
-
 const char *is_not_valid_c_instruction(const char *instruction) {
   const char *equal_sign = strchr(instruction, '=');
   const char *semicolon = strchr(instruction, ';');
@@ -162,6 +187,10 @@ const char *is_not_valid_c_instruction(const char *instruction) {
 void reset_fields(Parser *parser, TranslatedCode *code) {
   parser->currentInstruction[0] = '\0'; // set all string buffers to empty
   parser->symbol[0] = '\0';
+  parser->isConstant = false;
+  parser->constValue = 0;
+  parser->isExpression = false;
+  parser->expressionPos = 0;
   parser->jumpMnemonic[0] = '\0';
   parser->compMnemonic[0] = '\0';
   parser->destMnemonic[0] = '\0';
@@ -173,24 +202,3 @@ void reset_fields(Parser *parser, TranslatedCode *code) {
   code->dest[0] = '\0';
   code->jump[0] = '\0';
 }
-
-void clean_output(Writer *writer) { writer->output[0] = '\0'; }
-
-void int_str_to_bit_str(const char *in, char *bit, size_t buf_size) {
-  if (!in) {
-    return;
-  }
-  bit[0] = '0'; // A-instruction starts with 0
-  int integer = 0;
-  str_to_int(in, &integer);
-  int remainder = 0, result = integer;
-  for (int i = (int)buf_size - 2; i > 0; i--) {
-    remainder = result % 2;
-    result /= 2;
-
-    bit[i] = (remainder ? '1' : '0');
-
-    // print_debug(dbg, "result %d remainder %d\n", result, remainder);
-  }
-  bit[buf_size - 1] = '\0';
-}
@@ -10,6 +10,8 @@ typedef struct {
   bool enabled;
 } Debugger;
 
+typedef enum { LITERAL_NONE, LITERAL_OK, LITERAL_BAD_DIGIT, LITERAL_MISSING_DIGITS, LITERAL_OVERFLOW } LiteralStatus;
+
 #define FREE(p)                                                                                                        \
   do {                                                                                                                 \
     free(p);                                                                                                           \
@@ -50,9 +52,8 @@ static inline void print_debug(Debugger *dbg, const char *format, ...) {
 }
 #endif
 
-bool is_constant(const char *c);
-const char *is_not_valid_symbol(char *symbol, InstructionType type);
-bool is_valid_const_size(const char *string);
+LiteralStatus parse_literal(const char *literal, int *out, const char **bad_char);
+const char *is_not_valid_symbol(char *symbol);
 const char *is_not_valid_c_instruction(const char *instruction);
 void init_debugger(Debugger *debugger, bool enabled);
 void check_io_error(FILE *file, const char *filename);
@@ -61,8 +62,7 @@ void remove_comment_inplace(char *buffer);
 void print_syntax_error(const char *line, const char *type, int line_number, int position, const char *format, ...)
     __attribute__((format(printf, 5, 6)));
 void reset_fields(Parser *parser, TranslatedCode *code);
-void clean_output(Writer *writer);
-void int_str_to_bit_str(const char *in, char *bit, size_t buf_size);
 
+extern const int MAX_CONSTANT_SIZE;
 extern Debugger debugger;
 extern Debugger *dbg;
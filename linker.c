@@ -0,0 +1,116 @@
+#include "linker.h"
+#include "helper.h"
+#include "module.h"
+#include "symbol.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { FIRST_VARIABLE_ADDRESS = 16, LAST_VARIABLE_ADDRESS = 16383 };
+
+// lays the modules out in ROM in the order given, resolves every relocation and allocates
+// variables from address 16 in order of first appearance. on success *rom is malloc'd
+bool link_modules(Module *modules, size_t count, uint16_t **rom, size_t *rom_size) {
+  bool ok = true;
+  size_t *bases = malloc((count ? count : 1) * sizeof *bases);
+  if (!bases) {
+    perror("linker allocation failed");
+    exit(1);
+  }
+
+  size_t total = 0;
+  for (size_t m = 0; m < count; m++) {
+    bases[m] = total;
+    total += modules[m].codeCount;
+  }
+  if (total > ROM_SIZE) {
+    fprintf(stderr, "[ERROR] Link error: program is %zu words long, ROM only holds %d\n", total, ROM_SIZE);
+    free(bases);
+    return false;
+  }
+
+  SymbolTable labels;
+  symbol_table_init(&labels);
+  for (size_t m = 0; m < count; m++) {
+    const SymbolTable *module_labels = &modules[m].labels;
+    for (size_t i = 0; i < module_labels->capacity; i++) {
+      const Symbol *label = &module_labels->entries[i];
+      if (!label->name)
+        continue;
+      if (!add_entry(&labels, label->name, (int)bases[m] + label->address)) {
+        fprintf(stderr, "[ERROR] Link error: label '%s' in %s is already defined in another module\n", label->name,
+                modules[m].name);
+        ok = false;
+      }
+    }
+  }
+
+  uint16_t *code = malloc((total ? total : 1) * sizeof *code);
+  if (!code) {
+    perror("linker allocation failed");
+    exit(1);
+  }
+  for (size_t m = 0; m < count; m++) {
+    if (modules[m].codeCount)
+      memcpy(code + bases[m], modules[m].code, modules[m].codeCount * sizeof *code);
+  }
+
+  SymbolTable variables;
+  symbol_table_init(&variables);
+  int next_variable = FIRST_VARIABLE_ADDRESS;
+  for (size_t m = 0; ok && m < count; m++) {
+    const Module *module = &modules[m];
+    for (size_t i = 0; i < module->relocCount; i++) {
+      const Relocation *reloc = &module->relocs[i];
+      uint16_t *word = &code[bases[m] + reloc->offset];
+      if (reloc->kind == RELOC_ROM) {
+        *word = (uint16_t)(*word + bases[m]);
+        if (*word > MAX_CONSTANT_SIZE) {
+          fprintf(stderr, "[ERROR] Link error: label address at ROM[%u] of %s is out of range\n", (unsigned)reloc->offset,
+                  module->name);
+          ok = false;
+        }
+        continue;
+      }
+      const char *symbol = module->externs[reloc->symbol];
+      int address = get_address(&labels, symbol);
+      if (address < 0 && reloc->kind == RELOC_LABEL) {
+        fprintf(stderr, "[ERROR] Link error: '%s' used in %s is not a label of any module\n", symbol, module->name);
+        ok = false;
+        continue;
+      }
+      if (address < 0) {
+        address = get_address(&variables, symbol);
+      }
+      if (address < 0) {
+        if (next_variable > LAST_VARIABLE_ADDRESS) {
+          fprintf(stderr, "[ERROR] Link error: no RAM left for variable '%s' in %s\n", symbol, module->name);
+          ok = false;
+          break;
+        }
+        address = next_variable++;
+        add_entry(&variables, symbol, address);
+        print_debug(dbg, "allocated variable \"%s\" at RAM[%d]\n", symbol, address);
+      }
+      // the word already holds the addend of expressions like SYMBOL+5
+      *word = (uint16_t)(*word + address);
+      if (*word > MAX_CONSTANT_SIZE) {
+        fprintf(stderr, "[ERROR] Link error: address of '%s' plus offset in %s is out of range\n", symbol,
+                module->name);
+        ok = false;
+      }
+    }
+  }
+
+  symbol_table_destroy(&variables);
+  symbol_table_destroy(&labels);
+  free(bases);
+  if (!ok) {
+    free(code);
+    return false;
+  }
+  *rom = code;
+  *rom_size = total;
+  return true;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "module.h"
+#include <stddef.h>
+#include <stdint.h>
+
+bool link_modules(Module *modules, size_t count, uint16_t **rom, size_t *rom_size);
@@ -1,15 +1,174 @@
-#include "code.h"
+#include "assembler.h"
+#include "cache.h"
 #include "helper.h"
-#include "parser.h"
+#include "linker.h"
+#include "module.h"
+#include "rom.h"
 #include "strlib.h"
 #include "types.h"
+#include "vm.h"
 #include "writer.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 int g_status = EXIT_FAILURE;
 
+static void print_usage(const char *program) {
+  printf("Usage: %s [options] <file_name.asm|.vm>\n", program);
+  printf("       %s -c <module.asm|.vm>...                      assemble each module to <module>.hobj\n", program);
+  printf("       %s -o <program.hack> <module.asm|.vm|.hobj>... link modules into one program\n", program);
+  printf("       %s -o <program.hrom> <module.asm|.vm|.hobj>... link into a compressed ROM file\n", program);
+  printf("       %s -d <program.hrom>...                        decode each ROM file to <program>.hack\n", program);
+  printf("Options, given before any mode:\n");
+  printf("  --no-cache     parse every line, without the per-line instruction cache\n");
+  printf("  --cache-stats  print instruction cache hits and misses for each assembled file\n");
+}
+
+static bool is_source_file(const char *filename) {
+  return str_ends_with(filename, ".asm") || str_ends_with(filename, ".vm");
+}
+
+// loads a module from an object file, or assembles/translates it from source
+static bool load_module(const char *filename, Module *module) {
+  if (str_ends_with(filename, ".hobj")) {
+    return module_read(module, filename);
+  }
+  if (str_ends_with(filename, ".vm")) {
+    return translate_vm_file(filename, module);
+  }
+  return assemble_file(filename, module);
+}
+
+static int compile_modules(int count, char **filenames) {
+  bool has_errors = false;
+  for (int i = 0; i < count; i++) {
+    if (!is_source_file(filenames[i])) {
+      fprintf(stderr, "[ERROR] %s is not an .asm or .vm file\n", filenames[i]);
+      has_errors = true;
+      continue;
+    }
+    char object_name[S256];
+    snprintf(object_name, sizeof object_name, "%.*s.hobj", (int)(strrchr(filenames[i], '.') - filenames[i]),
+             filenames[i]);
+
+    Module module;
+    module_init(&module, filenames[i]);
+    if (load_module(filenames[i], &module) && module_write(&module, object_name)) {
+      fprintf(stderr, "Assembled %s into %s\n", filenames[i], object_name);
+    } else {
+      fprintf(stderr, "\nAssembly of %s failed because of one or more errors\n", filenames[i]);
+      has_errors = true;
+    }
+    module_destroy(&module);
+  }
+  return has_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// deletes a half written output, but never a device like /dev/null that was named as the output
+static void remove_output(const char *output_name) {
+  struct stat info;
+  if (stat(output_name, &info) == 0 && (info.st_mode & S_IFMT) == S_IFREG) {
+    remove(output_name);
+  }
+}
+
+static bool write_hack_file(const char *output_name, const uint16_t *rom, size_t rom_size) {
+  Writer w;
+  Writer *writer = &w;
+  writer_init(writer, output_name);
+  if (!writer->outputFile) {
+    return false;
+  }
+  bool ok = write_rom(writer, rom, rom_size);
+  if (!writer_destroy(writer))
+    ok = false;
+  if (!ok) {
+    fprintf(stderr, "[ERROR] I/O error on %s: ", output_name);
+    perror("");
+  }
+  return ok;
+}
+
+// links the modules and writes the program as .hack text, or as a compressed .hrom
+static bool build_program(const char *output_name, Module *modules, size_t count) {
+  uint16_t *rom = nullptr;
+  size_t rom_size = 0;
+  if (!link_modules(modules, count, &rom, &rom_size)) {
+    return false;
+  }
+  bool ok = str_ends_with(output_name, ".hrom") ? rom_write(output_name, rom, rom_size)
+                                                : write_hack_file(output_name, rom, rom_size);
+  free(rom);
+  return ok;
+}
+
+static int decode_roms(int count, char **filenames) {
+  bool has_errors = false;
+  for (int i = 0; i < count; i++) {
+    if (!str_ends_with(filenames[i], ".hrom")) {
+      fprintf(stderr, "[ERROR] %s is not an .hrom file\n", filenames[i]);
+      has_errors = true;
+      continue;
+    }
+    char output_name[S256];
+    snprintf(output_name, sizeof output_name, "%.*s.hack", (int)strlen(filenames[i]) - 5, filenames[i]);
+
+    uint16_t *rom = nullptr;
+    size_t rom_size = 0;
+    if (rom_read(filenames[i], &rom, &rom_size) && write_hack_file(output_name, rom, rom_size)) {
+      fprintf(stderr, "Decoded %s into %s\n", filenames[i], output_name);
+    } else {
+      has_errors = true;
+    }
+    free(rom);
+  }
+  return has_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// loads every input, prepends the VM bootstrap when the program has a Sys.init, then links
+static bool load_and_build(const char *output_name, int count, char **filenames) {
+  // slot 0 is kept for the bootstrap
+  Module *modules = calloc((size_t)count + 1, sizeof *modules);
+  if (!modules) {
+    perror("module allocation failed");
+    return false;
+  }
+  bool ok = true;
+  for (int i = 0; i < count; i++) {
+    module_init(&modules[i + 1], filenames[i]);
+    if (!load_module(filenames[i], &modules[i + 1])) {
+      fprintf(stderr, "\nLoading %s failed because of one or more errors\n", filenames[i]);
+      ok = false;
+    }
+  }
+
+  bool bootstrap = ok && needs_vm_bootstrap(modules + 1, (size_t)count);
+  if (bootstrap) {
+    module_init(&modules[0], "bootstrap");
+    vm_bootstrap(&modules[0]);
+  }
+  ok = ok && build_program(output_name, bootstrap ? modules : modules + 1, (size_t)count + bootstrap);
+
+  for (int i = bootstrap ? 0 : 1; i <= count; i++) {
+    module_destroy(&modules[i]);
+  }
+  free(modules);
+  return ok;
+}
+
+static int link_program(const char *output_name, int count, char **filenames) {
+  if (!load_and_build(output_name, count, filenames)) {
+    remove_output(output_name);
+    fprintf(stderr, "\nBuilding %s failed because of one or more errors\n", output_name);
+    return EXIT_FAILURE;
+  }
+  fprintf(stderr, "\nBuilding %s successful!\n", output_name);
+  return EXIT_SUCCESS;
+}
+
 int main(int argc, char **argv) {
   // initialize debugger
   bool en = false;
@@ -20,58 +179,48 @@ int main(int argc, char **argv) {
   print_debug(dbg, "Heya, debug mode is on!\n");
 
   printf("Welcome to Afif's Hack Assembler!\n\n");
-  if (argc < 2 || !str_ends_with(argv[1], ".asm")) {
-    printf("Usage: %s <file_name.asm>\n", argv[0]);
+  const char *program = argv[0];
+  while (argc >= 2 && strncmp(argv[1], "--", 2) == 0) {
+    if (strcmp(argv[1], "--no-cache") == 0) {
+      cache_options.enabled = false;
+    } else if (strcmp(argv[1], "--cache-stats") == 0) {
+      cache_options.printStats = true;
+    } else {
+      fprintf(stderr, "[ERROR] unknown option '%s'\n", argv[1]);
+      print_usage(program);
+      return g_status;
+    }
+    argc--;
+    argv++;
+  }
+  if (argc >= 3 && strcmp(argv[1], "-c") == 0) {
+    g_status = compile_modules(argc - 2, argv + 2);
+    return g_status;
+  }
+  if (argc >= 3 && strcmp(argv[1], "-d") == 0) {
+    g_status = decode_roms(argc - 2, argv + 2);
+    return g_status;
+  }
+  if (argc >= 4 && strcmp(argv[1], "-o") == 0) {
+    g_status = link_program(argv[2], argc - 3, argv + 3);
+    return g_status;
+  }
+  if (argc < 2 || !is_source_file(argv[1])) {
+    print_usage(program);
     return g_status;
   }
   char file_name[S128];
   snprintf(file_name, sizeof file_name, "%s", argv[1]);
-
-  Parser p;
-  Parser *parser = &p;
-  TranslatedCode c;
-  TranslatedCode *code = &c;
-  Writer w;
-  Writer *writer = &w;
-  parser_init(parser, file_name);
-  file_name[strlen( file_name) - 4] = '\0'; // remove .asm
-  char output_name[S128];
+  *strrchr(file_name, '.') = '\0'; // remove .asm or .vm
+  char output_name[S256];
   snprintf(output_name, sizeof output_name, "%s.hack", file_name);
-  writer_init(writer, output_name);
-  bool has_errors = false;
-  while (advance(parser)) {
-    if (!has_more_lines(parser))
-      break;
-    instruction_type(parser);
 
-    if (parser->type == A_INSTRUCTION || parser->type == L_INSTRUCTION) {
-      get_symbol(parser);
-    } else {
-      parse_c_instruction(parser, code);
-    }
-    if (parser->errorStatus) {
-      has_errors = true;
-      reset_fields(parser, code);
-      continue;
-    }
-    print_debug(dbg, "successfully parsed %s on line %d\n", parser->currentInstruction, parser->lineNumber);
-    if (!has_errors) {
-      assemble_bits(parser, code, writer);
-      if (writer->output[0]) {
-        write_output(writer);
-        clean_output(writer);
-      }
-    }
-  }
-
-  parser_destroy(parser);
-  writer_destroy(writer);
-  if (has_errors) {
-    fprintf(stderr, "\nAssembly of %s.asm failed because of one or more errors\n", file_name);
-    remove(output_name);
+  if (!load_and_build(output_name, 1, &argv[1])) {
+    fprintf(stderr, "\nAssembly of %s failed because of one or more errors\n", argv[1]);
+    remove_output(output_name);
     g_status = EXIT_FAILURE;
   } else {
-    fprintf(stderr, "\nAssembly of %s.asm successful! check %s\n", file_name, output_name);
+    fprintf(stderr, "\nAssembly of %s successful! check %s\n", argv[1], output_name);
     g_status = EXIT_SUCCESS;
   }
   return g_status;
@@ -0,0 +1,371 @@
+#include "module.h"
+#include "helper.h"
+#include "symbol.h"
+#include "types.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// object file layout, all integers little-endian:
+//   "HOBJ" u16 version
+//   u32 code count, u32 label count, u32 extern count, u32 relocation count
+//   u16 code[code count]
+//   labels:      u16 name length, name, u16 address
+//   externs:     u16 name length, name
+//   relocations: u32 offset, u32 symbol, u8 kind
+static const char OBJECT_MAGIC[4] = {'H', 'O', 'B', 'J'};
+enum { OBJECT_VERSION = 1 };
+
+static void *grow_array(void *array, size_t *capacity, size_t element_size) {
+  size_t new_capacity = *capacity ? *capacity * 2 : S256;
+  void *new_array = realloc(array, new_capacity * element_size);
+  if (!new_array) {
+    perror("module allocation failed");
+    exit(1);
+  }
+  *capacity = new_capacity;
+  return new_array;
+}
+
+void module_init(Module *module, const char *name) {
+  snprintf(module->name, sizeof module->name, "%s", name);
+  module->code = nullptr;
+  module->codeCount = module->codeCapacity = 0;
+  symbol_table_init(&module->labels);
+  symbol_table_init(&module->constants);
+  symbol_table_init(&module->exports);
+  module->externs = nullptr;
+  module->externCount = module->externCapacity = 0;
+  symbol_table_init(&module->externIndex);
+  module->relocs = nullptr;
+  module->relocCount = module->relocCapacity = 0;
+}
+
+void module_destroy(Module *module) {
+  if (!module)
+    return;
+  FREE(module->code);
+  for (size_t i = 0; i < module->externCount; i++) {
+    free(module->externs[i]);
+  }
+  FREE(module->externs);
+  FREE(module->relocs);
+  symbol_table_destroy(&module->labels);
+  symbol_table_destroy(&module->constants);
+  symbol_table_destroy(&module->exports);
+  symbol_table_destroy(&module->externIndex);
+}
+
+void module_emit(Module *module, uint16_t word) {
+  if (module->codeCount == module->codeCapacity) {
+    module->code = grow_array(module->code, &module->codeCapacity, sizeof *module->code);
+  }
+  module->code[module->codeCount++] = word;
+}
+
+static uint32_t intern_extern(Module *module, const char *symbol) {
+  int index = get_address(&module->externIndex, symbol);
+  if (index >= 0) {
+    return (uint32_t)index;
+  }
+  if (module->externCount == module->externCapacity) {
+    module->externs = grow_array(module->externs, &module->externCapacity, sizeof *module->externs);
+  }
+  module->externs[module->externCount] = strdup(symbol);
+  add_entry(&module->externIndex, symbol, (int)module->externCount);
+  return (uint32_t)module->externCount++;
+}
+
+static void add_relocation(Module *module, uint32_t offset, uint32_t symbol, RelocationKind kind) {
+  if (module->relocCount == module->relocCapacity) {
+    module->relocs = grow_array(module->relocs, &module->relocCapacity, sizeof *module->relocs);
+  }
+  module->relocs[module->relocCount++] = (Relocation){.offset = offset, .symbol = symbol, .kind = kind};
+}
+
+// emits a placeholder A-instruction for a symbol, it gets resolved by module_finalize or the linker.
+// returns the symbol's extern index for module_emit_extern
+uint32_t module_emit_reference(Module *module, const char *symbol) {
+  uint32_t index = intern_extern(module, symbol);
+  module_emit_extern(module, index);
+  return index;
+}
+
+void module_emit_extern(Module *module, uint32_t index) {
+  add_relocation(module, (uint32_t)module->codeCount, index, RELOC_EXTERN);
+  module_emit(module, 0);
+}
+
+// like module_emit_reference, for jump targets that must never become variables
+void module_emit_label_reference(Module *module, const char *label) {
+  add_relocation(module, (uint32_t)module->codeCount, intern_extern(module, label), RELOC_LABEL);
+  module_emit(module, 0);
+}
+
+// marks an already emitted word as relative to the module base (symbol == nullptr) or to a symbol
+void module_relocate(Module *module, size_t offset, const char *symbol) {
+  if (symbol) {
+    add_relocation(module, (uint32_t)offset, intern_extern(module, symbol), RELOC_EXTERN);
+  } else {
+    add_relocation(module, (uint32_t)offset, 0, RELOC_ROM);
+  }
+}
+
+// returns false if the label is already defined in this module
+bool module_define_label(Module *module, const char *label) {
+  return add_entry(&module->labels, label, (int)module->codeCount);
+}
+
+// returns false if the constant is already defined in this module
+bool module_define_constant(Module *module, const char *name, int value) {
+  return add_entry(&module->constants, name, value);
+}
+
+// makes a label visible to other modules, exporting the same label twice is harmless
+void module_export(Module *module, const char *label, int line_number) {
+  add_entry(&module->exports, label, line_number);
+}
+
+static int compare_relocations(const void *a, const void *b) {
+  uint32_t offset_a = ((const Relocation *)a)->offset, offset_b = ((const Relocation *)b)->offset;
+  return (offset_a > offset_b) - (offset_a < offset_b);
+}
+
+// resolves references to the module's own labels and constants. labels become ROM relocations,
+// constants are patched in and their relocations dropped. relocations end up sorted by offset
+// so the linker allocates variables in order of first appearance. labels that aren't exported
+// are dropped afterwards, so only exported ones reach the linker and the object file
+void module_finalize(Module *module) {
+  const uint32_t LABEL = UINT32_MAX, CONSTANT = UINT32_MAX - 1;
+  uint32_t *remap = malloc((module->externCount ? module->externCount : 1) * sizeof *remap);
+  if (!remap) {
+    perror("module allocation failed");
+    exit(1);
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < module->externCount; i++) {
+    if (contains(&module->labels, module->externs[i])) {
+      remap[i] = LABEL;
+    } else if (contains(&module->constants, module->externs[i])) {
+      remap[i] = CONSTANT;
+    } else {
+      remap[i] = (uint32_t)kept++;
+    }
+  }
+
+  size_t relocs_kept = 0;
+  for (size_t i = 0; i < module->relocCount; i++) {
+    Relocation reloc = module->relocs[i];
+    if (reloc.kind != RELOC_ROM) {
+      const char *symbol = module->externs[reloc.symbol];
+      uint16_t *word = &module->code[reloc.offset];
+      if (remap[reloc.symbol] == LABEL) {
+        *word = (uint16_t)(*word + get_address(&module->labels, symbol));
+        reloc.kind = RELOC_ROM;
+        reloc.symbol = 0;
+      } else if (remap[reloc.symbol] == CONSTANT) {
+        *word = (uint16_t)(*word + get_address(&module->constants, symbol));
+        continue;
+      } else {
+        reloc.symbol = remap[reloc.symbol];
+      }
+    }
+    module->relocs[relocs_kept++] = reloc;
+  }
+  module->relocCount = relocs_kept;
+  qsort(module->relocs, module->relocCount, sizeof *module->relocs, compare_relocations);
+
+  for (size_t i = 0; i < module->externCount; i++) {
+    if (remap[i] >= CONSTANT) {
+      free(module->externs[i]);
+    } else {
+      module->externs[remap[i]] = module->externs[i];
+    }
+  }
+  free(remap);
+
+  // rebuild the index over the compacted externs
+  symbol_table_destroy(&module->externIndex);
+  symbol_table_init(&module->externIndex);
+  for (size_t i = 0; i < kept; i++) {
+    add_entry(&module->externIndex, module->externs[i], (int)i);
+  }
+  module->externCount = kept;
+
+  SymbolTable exported;
+  symbol_table_init(&exported);
+  for (size_t i = 0; i < module->labels.capacity; i++) {
+    const Symbol *label = &module->labels.entries[i];
+    if (label->name && contains(&module->exports, label->name)) {
+      add_entry(&exported, label->name, label->address);
+    }
+  }
+  symbol_table_destroy(&module->labels);
+  module->labels = exported;
+}
+
+static bool host_is_little_endian(void) {
+  const uint16_t one = 1;
+  return *(const uint8_t *)&one == 1;
+}
+
+static void write_u16(FILE *file, uint16_t value) {
+  uint8_t bytes[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+  fwrite(bytes, 1, sizeof bytes, file);
+}
+
+static void write_u32(FILE *file, uint32_t value) {
+  uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+  fwrite(bytes, 1, sizeof bytes, file);
+}
+
+static bool read_u16(FILE *file, uint16_t *value) {
+  uint8_t bytes[2];
+  if (fread(bytes, 1, sizeof bytes, file) != sizeof bytes)
+    return false;
+  *value = (uint16_t)(bytes[0] | bytes[1] << 8);
+  return true;
+}
+
+static bool read_u32(FILE *file, uint32_t *value) {
+  uint8_t bytes[4];
+  if (fread(bytes, 1, sizeof bytes, file) != sizeof bytes)
+    return false;
+  *value = (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+  return true;
+}
+
+// names longer than read_name accepts are refused, the object file would be unreadable
+static bool write_name(FILE *file, const char *name) {
+  size_t len = strlen(name);
+  if (len >= SYMBOL_SIZE) {
+    fprintf(stderr, "[ERROR] symbol '%.32s...' is longer than %d characters\n", name, SYMBOL_SIZE - 1);
+    return false;
+  }
+  write_u16(file, (uint16_t)len);
+  fwrite(name, 1, len, file);
+  return true;
+}
+
+static bool read_name(FILE *file, char *name, size_t size) {
+  uint16_t len;
+  if (!read_u16(file, &len) || len >= size)
+    return false;
+  if (fread(name, 1, len, file) != len)
+    return false;
+  name[len] = '\0';
+  return true;
+}
+
+bool module_write(const Module *module, const char *filename) {
+  FILE *file = fopen(filename, "wb");
+  if (!file) {
+    fprintf(stderr, "Error opening file '%s': ", filename);
+    perror("");
+    return false;
+  }
+
+  fwrite(OBJECT_MAGIC, 1, sizeof OBJECT_MAGIC, file);
+  write_u16(file, OBJECT_VERSION);
+  write_u32(file, (uint32_t)module->codeCount);
+  write_u32(file, (uint32_t)module->labels.count);
+  write_u32(file, (uint32_t)module->externCount);
+  write_u32(file, (uint32_t)module->relocCount);
+
+  if (host_is_little_endian()) {
+    fwrite(module->code, sizeof *module->code, module->codeCount, file);
+  } else {
+    for (size_t i = 0; i < module->codeCount; i++) {
+      write_u16(file, module->code[i]);
+    }
+  }
+  bool names_ok = true;
+  for (size_t i = 0; i < module->labels.capacity; i++) {
+    const Symbol *label = &module->labels.entries[i];
+    if (label->name) {
+      names_ok = write_name(file, label->name) && names_ok;
+      write_u16(file, (uint16_t)label->address);
+    }
+  }
+  for (size_t i = 0; i < module->externCount; i++) {
+    names_ok = write_name(file, module->externs[i]) && names_ok;
+  }
+  for (size_t i = 0; i < module->relocCount; i++) {
+    write_u32(file, module->relocs[i].offset);
+    write_u32(file, module->relocs[i].symbol);
+    fputc(module->relocs[i].kind, file);
+  }
+
+  bool ok = !ferror(file);
+  if (fclose(file) != 0)
+    ok = false;
+  if (!ok) {
+    fprintf(stderr, "[ERROR] I/O error on %s: ", filename);
+    perror("");
+  }
+  if (!ok || !names_ok) {
+    remove(filename);
+    return false;
+  }
+  return true;
+}
+
+// module must be freshly initialized
+bool module_read(Module *module, const char *filename) {
+  FILE *file = fopen(filename, "rb");
+  if (!file) {
+    fprintf(stderr, "Error opening file '%s': ", filename);
+    perror("");
+    return false;
+  }
+
+  char magic[sizeof OBJECT_MAGIC];
+  uint16_t version;
+  uint32_t code_count, label_count, extern_count, reloc_count;
+  bool ok = fread(magic, 1, sizeof magic, file) == sizeof magic && memcmp(magic, OBJECT_MAGIC, sizeof magic) == 0 &&
+            read_u16(file, &version) && version == OBJECT_VERSION && read_u32(file, &code_count) &&
+            read_u32(file, &label_count) && read_u32(file, &extern_count) && read_u32(file, &reloc_count) &&
+            code_count <= ROM_SIZE; // checked before it sizes the allocation below
+
+  if (ok && code_count) {
+    module->codeCapacity = code_count;
+    module->code = malloc(code_count * sizeof *module->code);
+    if (!module->code) {
+      perror("module allocation failed");
+      exit(1);
+    }
+    ok = fread(module->code, sizeof *module->code, code_count, file) == code_count;
+    if (ok && !host_is_little_endian()) {
+      for (size_t i = 0; i < code_count; i++) {
+        const uint8_t *bytes = (const uint8_t *)&module->code[i];
+        module->code[i] = (uint16_t)(bytes[0] | bytes[1] << 8);
+      }
+    }
+    module->codeCount = code_count;
+  }
+
+  char name[SYMBOL_SIZE];
+  for (uint32_t i = 0; ok && i < label_count; i++) {
+    uint16_t address;
+    ok = read_name(file, name, sizeof name) && read_u16(file, &address) && address <= code_count &&
+         add_entry(&module->labels, name, address);
+  }
+  for (uint32_t i = 0; ok && i < extern_count; i++) {
+    ok = read_name(file, name, sizeof name) && intern_extern(module, name) == i;
+  }
+  for (uint32_t i = 0; ok && i < reloc_count; i++) {
+    uint32_t offset, symbol;
+    int kind;
+    ok = read_u32(file, &offset) && read_u32(file, &symbol) && (kind = fgetc(file)) != EOF &&
+         offset < code_count && (kind == RELOC_ROM || ((kind == RELOC_EXTERN || kind == RELOC_LABEL) && symbol < extern_count));
+    if (ok)
+      add_relocation(module, offset, symbol, (RelocationKind)kind);
+  }
+
+  fclose(file);
+  if (!ok) {
+    fprintf(stderr, "[ERROR] %s is not a valid object file\n", filename);
+  }
+  return ok;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "symbol.h"
+#include "types.h"
+#include <stddef.h>
+#include <stdint.h>
+
+enum { ROM_SIZE = 32768 };
+
+// A relocatable module: the code of one .asm file with ROM addresses relative to the
+// start of the module. Everything the module can't resolve by itself is left to the linker.
+typedef enum { RELOC_ROM, RELOC_EXTERN, RELOC_LABEL } RelocationKind;
+
+// the code word at offset holds an addend: the linker adds the module base (RELOC_ROM) or
+// the symbol's address (RELOC_EXTERN) to it. RELOC_LABEL is a RELOC_EXTERN that has to name
+// a label of some module, the linker reports it instead of allocating a variable
+typedef struct {
+  uint32_t offset; // module-relative ROM address of the A-instruction to patch
+  uint32_t symbol; // index into externs, unused for RELOC_ROM
+  RelocationKind kind;
+} Relocation;
+
+typedef struct {
+  char name[S128]; // source file, for diagnostics
+
+  uint16_t *code;
+  size_t codeCount;
+  size_t codeCapacity;
+
+  SymbolTable labels;    // module-relative ROM address, only the exported ones are left after module_finalize
+  SymbolTable exports;   // labels named by .global -> line of the .global, never written to the object file
+  SymbolTable constants; // .equ names, local to the module and never written to the object file
+
+  char **externs; // referenced symbols not defined in the module: labels of other modules or variables
+  size_t externCount;
+  size_t externCapacity;
+  SymbolTable externIndex; // extern name -> index into externs
+
+  Relocation *relocs;
+  size_t relocCount;
+  size_t relocCapacity;
+} Module;
+
+void module_init(Module *module, const char *name);
+void module_destroy(Module *module);
+
+void module_emit(Module *module, uint16_t word);
+uint32_t module_emit_reference(Module *module, const char *symbol);
+void module_emit_extern(Module *module, uint32_t index);
+void module_emit_label_reference(Module *module, const char *label);
+void module_relocate(Module *module, size_t offset, const char *symbol);
+bool module_define_label(Module *module, const char *label);
+bool module_define_constant(Module *module, const char *name, int value);
+void module_export(Module *module, const char *label, int line_number);
+void module_finalize(Module *module);
+
+bool module_write(const Module *module, const char *filename);
+bool module_read(Module *module, const char *filename);
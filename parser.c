@@ -1,11 +1,17 @@
 #include "parser.h"
 #include "code.h"
+#include "expr.h"
 #include "helper.h"
 #include "strlib.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#endif
+
+enum { PARSER_READ_BUFFER_SIZE = 1 << 20 };
 
 MnemonicMap comp_table[] = {
     {"0", "0101010"},   {"1", "0111111"},   {"-1", "0111010"},  {"D", "0001100"},   {"A", "0110000"},
@@ -35,9 +41,16 @@ void parser_init(Parser *parser, const char *Filename) {
   if (!file) {
     fprintf(stderr, "Error opening file '%s': ", Filename);
     perror("");
+    parser->inputFile = nullptr;
     return;
   }
 
+  // a big stdio buffer plus the sequential hint lets the kernel read ahead while we parse
+  setvbuf(file, nullptr, _IOFBF, PARSER_READ_BUFFER_SIZE);
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
   parser->errorStatus = false;
   parser->inputFile = file;
   parser->hasMoreLines = true; // assume there are lines initially
@@ -45,6 +58,10 @@ void parser_init(Parser *parser, const char *Filename) {
 
   parser->currentInstruction[0] = '\0'; // set all string buffers to empty
   parser->symbol[0] = '\0';
+  parser->isConstant = false;
+  parser->constValue = 0;
+  parser->isExpression = false;
+  parser->expressionPos = 0;
   parser->jumpMnemonic[0] = '\0';
   parser->compMnemonic[0] = '\0';
   parser->destMnemonic[0] = '\0';
@@ -64,19 +81,73 @@ void parser_destroy(Parser *parser) {
 
 bool has_more_lines(Parser *parser) { return parser->hasMoreLines; }
 
+// drops the part of a line that didn't fit in line_buf. returns false if that part has more than
+// whitespace and a comment, a comment split by the end of the buffer is cut from line_buf
+static bool discard_rest_of_line(FILE *file, char *line_buf) {
+  bool blank = true;
+  int ch = 0;
+  if (!strstr(line_buf, "//")) {
+    size_t length = strlen(line_buf);
+    ch = getc(file);
+    if (length && line_buf[length - 1] == '/' && ch == '/') {
+      line_buf[length - 1] = '\0';
+    } else {
+      while (ch == ' ' || ch == '\t' || ch == '\r')
+        ch = getc(file);
+      if (ch == '/') {
+        ch = getc(file);
+        blank = ch == '/';
+      } else {
+        blank = ch == '\n' || ch == EOF;
+      }
+    }
+  }
+  while (ch != EOF && ch != '\n')
+    ch = getc(file);
+  return blank;
+}
+
+// fgets filled line_buf with nothing but indentation, skips the rest of it and reads the line again
+// from its first character. a line that turns out to be blank comes back as "\n"
+static void skip_long_indentation(FILE *file, char *line_buf, int size) {
+  while (!strchr(line_buf, '\n') && !feof(file) && line_buf[strspn(line_buf, " \t\r")] == '\0') {
+    int ch = getc(file);
+    while (ch == ' ' || ch == '\t' || ch == '\r')
+      ch = getc(file);
+    if (ch == EOF || ch == '\n' || ungetc(ch, file) == EOF || !fgets(line_buf, size, file)) {
+      snprintf(line_buf, (size_t)size, "\n");
+      return;
+    }
+  }
+}
+
 bool advance(Parser *parser) {
   char line_buf[S512];
   while (fgets(line_buf, sizeof line_buf, parser->inputFile)) {
     parser->lineNumber++;
 
+    // a line longer than the buffer would come back from fgets in pieces, only whitespace and a
+    // comment may be cut off
+    bool too_long = false;
+    skip_long_indentation(parser->inputFile, line_buf, (int)sizeof line_buf);
+    if (!strchr(line_buf, '\n') && !feof(parser->inputFile)) {
+      too_long = !discard_rest_of_line(parser->inputFile, line_buf);
+    }
+
     remove_comment_inplace(line_buf);
     str_trim_whitespace_inplace(line_buf);
 
-    if (!*line_buf) {
+    if (!*line_buf && !too_long) {
       continue; // skip comment or empty line
     }
-    printf("%s\n", line_buf);
+    print_debug(dbg, "read line %d: %s\n", parser->lineNumber, line_buf);
     snprintf(parser->currentInstruction, sizeof parser->currentInstruction, "%s", line_buf);
+    if (too_long || strlen(line_buf) >= sizeof parser->currentInstruction) {
+      print_syntax_error(parser->currentInstruction, "instruction", parser->lineNumber,
+                         (int)sizeof parser->currentInstruction - 1, "instruction is longer than %d characters",
+                         (int)sizeof parser->currentInstruction - 1);
+      parser->errorStatus = true;
+    }
     return true;
   }
   parser->hasMoreLines = false;
@@ -92,6 +163,9 @@ void instruction_type(Parser *parser) {
   } else if (str_starts_with(instruction, "(")) {
     parser->type = L_INSTRUCTION;
     snprintf(parser->typeString, sizeof parser->typeString, "L-instruction");
+  } else if (str_starts_with(instruction, ".")) {
+    parser->type = DIRECTIVE;
+    snprintf(parser->typeString, sizeof parser->typeString, "directive");
   } else {
     parser->type = C_INTRUCTION;
     snprintf(parser->typeString, sizeof parser->typeString, "C-instruction");
@@ -120,15 +194,48 @@ void get_symbol(Parser *parser) {
     if (strlen(instruction) < 2) {
       print_syntax_error(instruction, parser->typeString, ln, (int)strlen(instruction), "missing symbol after @");
       parser->errorStatus = true;
+      return;
     }
 
     // skip the @, copy the rest
     char a_symbol[S256];
     snprintf(a_symbol, sizeof a_symbol, "%s", instruction + 1);
-    const char *invalid_symbol_ptr = is_not_valid_symbol(a_symbol, type);
+    if (is_expression(a_symbol)) {
+      // evaluated by the assembler, it needs the module's labels and constants
+      parser->isExpression = true;
+      parser->expressionPos = 1;
+      print_debug(dbg, "found expression \"%s\" from the A-instruction\n", a_symbol);
+      return;
+    }
+    const char *bad_char = nullptr;
+    switch (parse_literal(a_symbol, &parser->constValue, &bad_char)) {
+    case LITERAL_OK:
+      parser->isConstant = true;
+      snprintf(parser->symbol, sizeof parser->symbol, "%s", a_symbol);
+      print_debug(dbg, "found constant %d from the A-instruction\n", parser->constValue);
+      return;
+    case LITERAL_BAD_DIGIT:
+      print_syntax_error(instruction, parser->typeString, ln, 1 + (int)(bad_char - a_symbol),
+                         "invalid digit \'%c\' in constant", *bad_char);
+      parser->errorStatus = true;
+      return;
+    case LITERAL_MISSING_DIGITS:
+      print_syntax_error(instruction, parser->typeString, ln, 1 + (int)(bad_char - a_symbol),
+                         "missing digits after \'%.2s\'", a_symbol);
+      parser->errorStatus = true;
+      return;
+    case LITERAL_OVERFLOW:
+      print_syntax_error(instruction, parser->typeString, ln, 1, "constant is larger than %d", MAX_CONSTANT_SIZE);
+      parser->errorStatus = true;
+      return;
+    case LITERAL_NONE:
+      break;
+    }
+
+    const char *invalid_symbol_ptr = is_not_valid_symbol(a_symbol);
     if (!invalid_symbol_ptr) {
       snprintf(parser->symbol, sizeof parser->symbol, "%s", a_symbol);
-      print_debug(dbg, "found variable symbol/decimal constant \"%s\" from the A-instruction\n", a_symbol);
+      print_debug(dbg, "found variable symbol \"%s\" from the A-instruction\n", a_symbol);
       return;
     }
     _parser_symbol_print_error(ln, invalid_symbol_ptr, parser->typeString, instruction, a_symbol, 1);
@@ -145,7 +252,7 @@ void get_symbol(Parser *parser) {
     int len = (int)strlen(instruction);
     char l_symbol[S256];
     snprintf(l_symbol, sizeof l_symbol, "%.*s", len - 2, instruction + 1);
-    const char *invalid_symbol_ptr = is_not_valid_symbol(l_symbol, type);
+    const char *invalid_symbol_ptr = is_not_valid_symbol(l_symbol);
     if (!invalid_symbol_ptr) {
       snprintf(parser->symbol, sizeof parser->symbol, "%s", l_symbol);
       print_debug(dbg, "found label symbol \"%s\" from the L-instruction\n", l_symbol);
@@ -156,6 +263,61 @@ void get_symbol(Parser *parser) {
   }
 }
 
+// .equ NAME value
+// .global NAME
+// for .equ the value is left at expressionPos with isExpression set, .global has no value
+void parse_directive(Parser *parser) {
+  const char *instruction = parser->currentInstruction;
+  int ln = parser->lineNumber;
+
+  int directive_len = (int)strcspn(instruction, " \t");
+  bool is_equ = directive_len == 4 && strncmp(instruction, ".equ", 4) == 0;
+  bool is_global = directive_len == 7 && strncmp(instruction, ".global", 7) == 0;
+  if (!is_equ && !is_global) {
+    print_syntax_error(instruction, parser->typeString, ln, 0, "unknown directive \'%.*s\'", directive_len,
+                       instruction);
+    parser->errorStatus = true;
+    return;
+  }
+
+  const char *name = instruction + directive_len + strspn(instruction + directive_len, " \t");
+  int name_len = (int)strcspn(name, " \t");
+  if (!name_len) {
+    print_syntax_error(instruction, parser->typeString, ln, (int)strlen(instruction), "missing name after %.*s",
+                       directive_len, instruction);
+    parser->errorStatus = true;
+    return;
+  }
+  snprintf(parser->symbol, sizeof parser->symbol, "%.*s", name_len, name);
+  const char *invalid_symbol_ptr = is_not_valid_symbol(parser->symbol);
+  if (invalid_symbol_ptr) {
+    _parser_symbol_print_error(ln, invalid_symbol_ptr, parser->typeString, instruction, parser->symbol,
+                               (int)(name - instruction));
+    parser->errorStatus = true;
+    return;
+  }
+
+  const char *value = name + name_len + strspn(name + name_len, " \t");
+  if (is_global) {
+    if (*value) {
+      print_syntax_error(instruction, parser->typeString, ln, (int)(value - instruction), "unexpected \'%s\'", value);
+      parser->errorStatus = true;
+      return;
+    }
+    print_debug(dbg, "found exported label \"%s\"\n", parser->symbol);
+    return;
+  }
+  if (!*value) {
+    print_syntax_error(instruction, parser->typeString, ln, (int)strlen(instruction), "missing value after \'%s\'",
+                       parser->symbol);
+    parser->errorStatus = true;
+    return;
+  }
+  parser->isExpression = true;
+  parser->expressionPos = (int)(value - instruction);
+  print_debug(dbg, "found constant definition \"%s\" = \"%s\"\n", parser->symbol, value);
+}
+
 void get_dest_mnemonic(Parser *parser) {
   const char *instruction = parser->currentInstruction;
   char dest[S64];
@@ -14,6 +14,7 @@ bool advance(Parser *parser);
 void instruction_type(Parser *parser);
 void parse_c_instruction(Parser *parser, TranslatedCode *code);
 void get_symbol(Parser *parser);
+void parse_directive(Parser *parser);
 
 extern MnemonicMap comp_table[];
 extern MnemonicMap dest_table[];
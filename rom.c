@@ -0,0 +1,226 @@
+#include "rom.h"
+#include "helper.h"
+#include "module.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The LZ payload is a sequence of tokens, each starting with a varint (LEB128) header:
+//   header = count << 1      followed by count literal words (u16)
+//   header = length << 1 | 1 followed by a varint distance, copy length words from distance words back
+// Matching works on whole words, Hack code repeats in instruction-sized units (push/pop sequences,
+// call/return boilerplate), so word granularity finds the same matches as bytes with half the work.
+static const char ROM_MAGIC[4] = {'H', 'R', 'O', 'M'};
+enum { ROM_VERSION = 1, ROM_HEADER_SIZE = 16, MIN_MATCH = 3, HASH_BITS = 12 };
+
+static void put_u32(uint8_t *out, uint32_t value) {
+  out[0] = (uint8_t)value;
+  out[1] = (uint8_t)(value >> 8);
+  out[2] = (uint8_t)(value >> 16);
+  out[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t get_u32(const uint8_t *in) {
+  return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+static size_t put_varint(uint8_t *out, size_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (uint8_t)value;
+  return n;
+}
+
+// returns false on a truncated or oversized varint
+static bool get_varint(const uint8_t *in, size_t in_size, size_t *pos, size_t *value) {
+  size_t result = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (*pos >= in_size)
+      return false;
+    uint8_t byte = in[(*pos)++];
+    result |= (size_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint32_t hash_words(const uint16_t *words) {
+  uint32_t key = (uint32_t)words[0] | (uint32_t)words[1] << 16;
+  return (key * 2654435761u ^ words[2] * 0x9E3779B1u) >> (32 - HASH_BITS);
+}
+
+static size_t put_literals(uint8_t *out, const uint16_t *words, size_t count) {
+  size_t n = put_varint(out, count << 1);
+  for (size_t i = 0; i < count; i++) {
+    out[n++] = (uint8_t)words[i];
+    out[n++] = (uint8_t)(words[i] >> 8);
+  }
+  return n;
+}
+
+size_t rom_compress_bound(size_t rom_size) { return rom_size * 3 + 16; }
+
+// greedy LZ with a single candidate per hash bucket, out must hold rom_compress_bound(rom_size) bytes
+size_t rom_compress(const uint16_t *rom, size_t rom_size, uint8_t *out) {
+  static uint32_t table[1 << HASH_BITS]; // position + 1 of the last occurrence, 0 when empty
+  memset(table, 0, sizeof table);
+
+  size_t n = 0, literal_start = 0, i = 0;
+  while (i + MIN_MATCH <= rom_size) {
+    uint32_t h = hash_words(&rom[i]);
+    size_t candidate = table[h];
+    table[h] = (uint32_t)i + 1;
+    if (!candidate || memcmp(&rom[candidate - 1], &rom[i], MIN_MATCH * sizeof *rom) != 0) {
+      i++;
+      continue;
+    }
+    candidate--;
+    size_t length = MIN_MATCH;
+    while (i + length < rom_size && rom[candidate + length] == rom[i + length])
+      length++;
+
+    if (i > literal_start)
+      n += put_literals(out + n, &rom[literal_start], i - literal_start);
+    n += put_varint(out + n, length << 1 | 1);
+    n += put_varint(out + n, i - candidate);
+
+    for (size_t j = i + 1; j < i + length && j + MIN_MATCH <= rom_size; j++)
+      table[hash_words(&rom[j])] = (uint32_t)j + 1;
+    i += length;
+    literal_start = i;
+  }
+  if (rom_size > literal_start)
+    n += put_literals(out + n, &rom[literal_start], rom_size - literal_start);
+  return n;
+}
+
+// returns false if the payload is corrupt or doesn't decode to exactly rom_size words
+bool rom_decompress(const uint8_t *in, size_t in_size, uint16_t *rom, size_t rom_size) {
+  size_t pos = 0, o = 0;
+  while (pos < in_size) {
+    size_t header;
+    if (!get_varint(in, in_size, &pos, &header))
+      return false;
+    size_t count = header >> 1;
+    if (count > rom_size - o)
+      return false;
+
+    if (!(header & 1)) {
+      if (count * 2 > in_size - pos)
+        return false;
+      for (size_t i = 0; i < count; i++, pos += 2)
+        rom[o + i] = (uint16_t)(in[pos] | in[pos + 1] << 8);
+    } else {
+      size_t distance;
+      if (!get_varint(in, in_size, &pos, &distance) || distance == 0 || distance > o)
+        return false;
+      // the source may overlap the destination, copy forwards one word at a time
+      const uint16_t *src = &rom[o - distance];
+      for (size_t i = 0; i < count; i++)
+        rom[o + i] = src[i];
+    }
+    o += count;
+  }
+  return o == rom_size;
+}
+
+// writes LZ-compressed words, or raw words when compression doesn't pay off
+bool rom_write(const char *filename, const uint16_t *rom, size_t rom_size) {
+  uint8_t *buffer = malloc(ROM_HEADER_SIZE + rom_compress_bound(rom_size));
+  if (!buffer) {
+    perror("rom allocation failed");
+    exit(1);
+  }
+  uint8_t *payload = buffer + ROM_HEADER_SIZE;
+  size_t payload_size = rom_compress(rom, rom_size, payload);
+  RomEncoding encoding = ROM_ENCODING_LZ;
+  if (payload_size >= rom_size * 2) {
+    encoding = ROM_ENCODING_RAW;
+    payload_size = rom_size * 2;
+    for (size_t i = 0; i < rom_size; i++) {
+      payload[2 * i] = (uint8_t)rom[i];
+      payload[2 * i + 1] = (uint8_t)(rom[i] >> 8);
+    }
+  }
+
+  memcpy(buffer, ROM_MAGIC, sizeof ROM_MAGIC);
+  buffer[4] = ROM_VERSION;
+  buffer[5] = (uint8_t)encoding;
+  buffer[6] = buffer[7] = 0;
+  put_u32(buffer + 8, (uint32_t)rom_size);
+  put_u32(buffer + 12, (uint32_t)payload_size);
+  print_debug(dbg, "rom: %zu words in %zu payload bytes (%.2fx vs raw words, %.2fx vs .hack text)\n", rom_size,
+              payload_size, payload_size ? (double)(rom_size * 2) / (double)payload_size : 0.0,
+              payload_size ? (double)(rom_size * 17) / (double)(payload_size + ROM_HEADER_SIZE) : 0.0);
+
+  FILE *file = fopen(filename, "wb");
+  if (!file) {
+    fprintf(stderr, "Error opening file '%s': ", filename);
+    perror("");
+    free(buffer);
+    return false;
+  }
+  bool ok = fwrite(buffer, 1, ROM_HEADER_SIZE + payload_size, file) == ROM_HEADER_SIZE + payload_size;
+  if (fclose(file) != 0)
+    ok = false;
+  free(buffer);
+  if (!ok) {
+    fprintf(stderr, "[ERROR] I/O error on %s: ", filename);
+    perror("");
+    remove(filename);
+  }
+  return ok;
+}
+
+// on success *rom is malloc'd
+bool rom_read(const char *filename, uint16_t **rom, size_t *rom_size) {
+  FILE *file = fopen(filename, "rb");
+  if (!file) {
+    fprintf(stderr, "Error opening file '%s': ", filename);
+    perror("");
+    return false;
+  }
+
+  uint8_t header[ROM_HEADER_SIZE];
+  bool ok = fread(header, 1, sizeof header, file) == sizeof header &&
+            memcmp(header, ROM_MAGIC, sizeof ROM_MAGIC) == 0 && header[4] == ROM_VERSION &&
+            (header[5] == ROM_ENCODING_RAW || header[5] == ROM_ENCODING_LZ);
+  size_t words = ok ? get_u32(header + 8) : 0;
+  size_t payload_size = ok ? get_u32(header + 12) : 0;
+  // the ROM is at most ROM_SIZE words, anything bigger is a corrupt header
+  ok = ok && words <= ROM_SIZE && payload_size <= rom_compress_bound(words);
+
+  uint8_t *payload = ok ? malloc(payload_size ? payload_size : 1) : nullptr;
+  uint16_t *words_out = ok ? malloc((words ? words : 1) * sizeof *words_out) : nullptr;
+  if (ok && (!payload || !words_out)) {
+    perror("rom allocation failed");
+    exit(1);
+  }
+  ok = ok && fread(payload, 1, payload_size, file) == payload_size;
+  fclose(file);
+
+  if (ok && header[5] == ROM_ENCODING_RAW) {
+    ok = payload_size == words * 2;
+    for (size_t i = 0; ok && i < words; i++)
+      words_out[i] = (uint16_t)(payload[2 * i] | payload[2 * i + 1] << 8);
+  } else if (ok) {
+    ok = rom_decompress(payload, payload_size, words_out, words);
+  }
+  free(payload);
+
+  if (!ok) {
+    fprintf(stderr, "[ERROR] %s is not a valid ROM file\n", filename);
+    free(words_out);
+    return false;
+  }
+  *rom = words_out;
+  *rom_size = words;
+  return true;
+}
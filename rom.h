@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact ROM artifact (.hrom): a header followed by the ROM words, either raw or LZ-compressed.
+// all integers little-endian:
+//   "HROM" u8 version, u8 encoding, u16 reserved, u32 word count, u32 payload size, payload
+typedef enum { ROM_ENCODING_RAW, ROM_ENCODING_LZ } RomEncoding;
+
+size_t rom_compress_bound(size_t rom_size);
+size_t rom_compress(const uint16_t *rom, size_t rom_size, uint8_t *out);
+bool rom_decompress(const uint8_t *in, size_t in_size, uint16_t *rom, size_t rom_size);
+
+bool rom_write(const char *filename, const uint16_t *rom, size_t rom_size);
+bool rom_read(const char *filename, uint16_t **rom, size_t *rom_size);
@@ -1,4 +1,114 @@
 #include "symbol.h"
 #include "types.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+static const struct {
+  const char *name;
+  int address;
+} predefined_symbols[] = {
+    {"SP", 0},    {"LCL", 1},   {"ARG", 2},   {"THIS", 3},  {"THAT", 4},        {"R0", 0},
+    {"R1", 1},    {"R2", 2},    {"R3", 3},    {"R4", 4},    {"R5", 5},          {"R6", 6},
+    {"R7", 7},    {"R8", 8},    {"R9", 9},    {"R10", 10},  {"R11", 11},        {"R12", 12},
+    {"R13", 13},  {"R14", 14},  {"R15", 15},  {"SCREEN", 16384}, {"KBD", 24576}, {nullptr, 0}};
 
+enum { SYMBOL_TABLE_INITIAL_CAPACITY = 64 };
+
+uint32_t hash_symbol(const char *symbol) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  while (*symbol) {
+    hash ^= (unsigned char)*symbol++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static Symbol *find_slot(Symbol *entries, size_t capacity, const char *symbol) {
+  size_t i = hash_symbol(symbol) & (capacity - 1);
+  while (entries[i].name && strcmp(entries[i].name, symbol) != 0) {
+    i = (i + 1) & (capacity - 1); // linear probing
+  }
+  return &entries[i];
+}
+
+static void grow(SymbolTable *table) {
+  size_t new_capacity = table->capacity * 2;
+  Symbol *new_entries = calloc(new_capacity, sizeof *new_entries);
+  if (!new_entries) {
+    perror("symbol table allocation failed");
+    exit(1);
+  }
+  for (size_t i = 0; i < table->capacity; i++) {
+    if (table->entries[i].name) {
+      *find_slot(new_entries, new_capacity, table->entries[i].name) = table->entries[i];
+    }
+  }
+  free(table->entries);
+  table->entries = new_entries;
+  table->capacity = new_capacity;
+}
+
+void symbol_table_init(SymbolTable *table) {
+  table->capacity = SYMBOL_TABLE_INITIAL_CAPACITY;
+  table->count = 0;
+  table->entries = calloc(table->capacity, sizeof *table->entries);
+  if (!table->entries) {
+    perror("symbol table allocation failed");
+    exit(1);
+  }
+}
+
+void symbol_table_destroy(SymbolTable *table) {
+  if (!table || !table->entries)
+    return;
+  for (size_t i = 0; i < table->capacity; i++) {
+    free(table->entries[i].name);
+  }
+  free(table->entries);
+  table->entries = nullptr;
+  table->capacity = 0;
+  table->count = 0;
+}
+
+// returns false if the symbol is already in the table, the existing address is kept
+bool add_entry(SymbolTable *table, const char *symbol, int address) {
+  // keep the load factor under 3/4
+  if ((table->count + 1) * 4 > table->capacity * 3) {
+    grow(table);
+  }
+  Symbol *slot = find_slot(table->entries, table->capacity, symbol);
+  if (slot->name) {
+    return false;
+  }
+  slot->name = strdup(symbol);
+  if (!slot->name) {
+    perror("symbol table allocation failed");
+    exit(1);
+  }
+  slot->address = address;
+  table->count++;
+  return true;
+}
+
+bool contains(const SymbolTable *table, const char *symbol) {
+  return find_slot(table->entries, table->capacity, symbol)->name != nullptr;
+}
+
+// returns -1 if the symbol is not in the table
+int get_address(const SymbolTable *table, const char *symbol) {
+  const Symbol *slot = find_slot(table->entries, table->capacity, symbol);
+  return slot->name ? slot->address : -1;
+}
+
+bool lookup_predefined_symbol(const char *symbol, int *address) {
+  for (int i = 0; predefined_symbols[i].name; i++) {
+    if (strcmp(predefined_symbols[i].name, symbol) == 0) {
+      *address = predefined_symbols[i].address;
+      return true;
+    }
+  }
+  return false;
+}
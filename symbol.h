@@ -1,2 +1,23 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+  char *name; // nullptr marks an empty slot
+  int address;
+} Symbol;
+
+typedef struct {
+  Symbol *entries;
+  size_t capacity; // always a power of two
+  size_t count;
+} SymbolTable;
+
+void symbol_table_init(SymbolTable *table);
+void symbol_table_destroy(SymbolTable *table);
+bool add_entry(SymbolTable *table, const char *symbol, int address);
+bool contains(const SymbolTable *table, const char *symbol);
+int get_address(const SymbolTable *table, const char *symbol);
+bool lookup_predefined_symbol(const char *symbol, int *address);
+uint32_t hash_symbol(const char *symbol);
@@ -3,7 +3,10 @@
 #include <stdio.h>
 
 enum { S4 = 4, S8 = 8, S32 = 32, S64 = 64, S128 = 128, S256 = 256, S512 = 512 };
-typedef enum { NO_INSTRUCTION, A_INSTRUCTION, C_INTRUCTION, L_INSTRUCTION } InstructionType;
+// symbols are at most SYMBOL_SIZE - 1 characters in sources, object files and translated VM code.
+// an .asm line is shorter than that anyway, longer VM labels are reported as errors
+enum { SYMBOL_SIZE = S256 };
+typedef enum { NO_INSTRUCTION, A_INSTRUCTION, C_INTRUCTION, L_INSTRUCTION, DIRECTIVE } InstructionType;
 typedef struct {
   FILE *inputFile;
   char currentInstruction[S256];
@@ -14,7 +17,11 @@ typedef struct {
   // to be filled
   InstructionType type;
   char typeString[S32];
-  char symbol[S128];
+  char symbol[SYMBOL_SIZE];
+  bool isConstant;
+  int constValue;
+  bool isExpression;
+  int expressionPos; // column of the A-instruction expression or .equ value in currentInstruction
   char destMnemonic[S64];
   char compMnemonic[S64];
   char jumpMnemonic[S64];
@@ -22,7 +29,6 @@ typedef struct {
 
 typedef struct {
   FILE *outputFile;
-  char output[17]; // 16 bit output string
 } Writer;
 
 typedef struct {
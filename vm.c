@@ -0,0 +1,576 @@
+#include "vm.h"
+#include "code.h"
+#include "helper.h"
+#include "module.h"
+#include "parser.h"
+#include "strlib.h"
+#include "symbol.h"
+#include "types.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Translates .vm files straight into a Module, the same thing assemble_file produces from
+// .asm, so no intermediate assembly text is written or parsed again. Jump targets inside the
+// generated code (comparison results, return addresses) are ROM relocations rather than labels.
+
+enum { VM_MAX_TOKENS = 4, TEMP_BASE = 5, POINTER_BASE = 3, STACK_BASE = 256 };
+
+// every C-instruction the translator emits, encoded once from comp_table/dest_table/jump_table
+typedef enum {
+  C_D_A,
+  C_D_M,
+  C_D_D_PLUS_M,
+  C_D_M_MINUS_D,
+  C_D_M_PLUS_1,
+  C_D_D_MINUS_A,
+  C_A_M,
+  C_A_M_MINUS_1,
+  C_A_A_MINUS_1,
+  C_A_D_PLUS_M,
+  C_A_D_MINUS_A,
+  C_AM_M_PLUS_1,
+  C_AM_M_MINUS_1,
+  C_M_D,
+  C_M_0,
+  C_M_MINUS_1,
+  C_M_D_PLUS_M,
+  C_M_M_MINUS_D,
+  C_M_D_AND_M,
+  C_M_D_OR_M,
+  C_M_NEG_M,
+  C_M_NOT_M,
+  C_D_JEQ,
+  C_D_JGT,
+  C_D_JLT,
+  C_D_JNE,
+  C_0_JMP,
+  C_COUNT
+} VmCInstruction;
+
+static const struct {
+  const char *dest;
+  const char *comp;
+  const char *jump;
+} c_instructions[C_COUNT] = {
+    [C_D_A] = {"D", "A", "null"},          [C_D_M] = {"D", "M", "null"},
+    [C_D_D_PLUS_M] = {"D", "D+M", "null"}, [C_D_M_MINUS_D] = {"D", "M-D", "null"},
+    [C_D_M_PLUS_1] = {"D", "M+1", "null"}, [C_D_D_MINUS_A] = {"D", "D-A", "null"},
+    [C_A_M] = {"A", "M", "null"},          [C_A_M_MINUS_1] = {"A", "M-1", "null"},
+    [C_A_A_MINUS_1] = {"A", "A-1", "null"}, [C_A_D_PLUS_M] = {"A", "D+M", "null"},
+    [C_A_D_MINUS_A] = {"A", "D-A", "null"}, [C_AM_M_PLUS_1] = {"AM", "M+1", "null"},
+    [C_AM_M_MINUS_1] = {"AM", "M-1", "null"}, [C_M_D] = {"M", "D", "null"},
+    [C_M_0] = {"M", "0", "null"},          [C_M_MINUS_1] = {"M", "-1", "null"},
+    [C_M_D_PLUS_M] = {"M", "D+M", "null"}, [C_M_M_MINUS_D] = {"M", "M-D", "null"},
+    [C_M_D_AND_M] = {"M", "D&M", "null"},  [C_M_D_OR_M] = {"M", "D|M", "null"},
+    [C_M_NEG_M] = {"M", "-M", "null"},     [C_M_NOT_M] = {"M", "!M", "null"},
+    [C_D_JEQ] = {"null", "D", "JEQ"},      [C_D_JGT] = {"null", "D", "JGT"},
+    [C_D_JLT] = {"null", "D", "JLT"},      [C_D_JNE] = {"null", "D", "JNE"},
+    [C_0_JMP] = {"null", "0", "JMP"},
+};
+
+static uint16_t c_words[C_COUNT];
+static bool c_words_ready = false;
+
+static void init_c_words(void) {
+  if (c_words_ready)
+    return;
+  for (int i = 0; i < C_COUNT; i++) {
+    if (!encode_c_instruction(c_instructions[i].dest, c_instructions[i].comp, c_instructions[i].jump, &c_words[i])) {
+      fprintf(stderr, "[ERROR] VM translator uses unknown C-instruction %s=%s;%s\n", c_instructions[i].dest,
+              c_instructions[i].comp, c_instructions[i].jump);
+      exit(1);
+    }
+  }
+  c_words_ready = true;
+}
+
+typedef struct {
+  Module *module;
+  char fileName[SYMBOL_SIZE]; // basename without .vm, prefix of static variables
+  char function[SYMBOL_SIZE]; // current function, prefix of labels
+  SymbolTable jumpTargets;    // function$label of every goto and if-goto -> line of the first one
+  const char *line;
+  int lineNumber;
+  const char *tokens[VM_MAX_TOKENS];
+  int tokenLengths[VM_MAX_TOKENS];
+  int tokenCount;
+} VmTranslator;
+
+static void emit_c(VmTranslator *vm, VmCInstruction instruction) { module_emit(vm->module, c_words[instruction]); }
+
+static void emit_a(VmTranslator *vm, int value) { module_emit(vm->module, (uint16_t)value); }
+
+static void emit_a_symbol(VmTranslator *vm, const char *symbol) {
+  int address;
+  if (lookup_predefined_symbol(symbol, &address)) {
+    emit_a(vm, address);
+  } else {
+    module_emit_reference(vm->module, symbol);
+  }
+}
+
+// emits @<ROM address>, patched later with patch_rom_target
+static size_t emit_a_rom_target(VmTranslator *vm) {
+  emit_a(vm, 0);
+  module_relocate(vm->module, vm->module->codeCount - 1, nullptr);
+  return vm->module->codeCount - 1;
+}
+
+static void patch_rom_target(VmTranslator *vm, size_t offset) { vm->module->code[offset] = (uint16_t)vm->module->codeCount; }
+
+static void push_d(VmTranslator *vm) {
+  emit_a_symbol(vm, "SP");
+  emit_c(vm, C_AM_M_PLUS_1);
+  emit_c(vm, C_A_A_MINUS_1);
+  emit_c(vm, C_M_D);
+}
+
+// leaves the popped value in D
+static void pop_d(VmTranslator *vm) {
+  emit_a_symbol(vm, "SP");
+  emit_c(vm, C_AM_M_MINUS_1);
+  emit_c(vm, C_D_M);
+}
+
+static void print_vm_error(const VmTranslator *vm, int token, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static void print_vm_error(const VmTranslator *vm, int token, const char *format, ...) {
+  char message[S128];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(message, sizeof message, format, args);
+  va_end(args);
+  int position = token < vm->tokenCount ? (int)(vm->tokens[token] - vm->line) : (int)strlen(vm->line);
+  print_syntax_error(vm->line, "VM command", vm->lineNumber, position, "%s", message);
+}
+
+static bool token_is(const VmTranslator *vm, int token, const char *word) {
+  return vm->tokenLengths[token] == (int)strlen(word) && strncmp(vm->tokens[token], word, strlen(word)) == 0;
+}
+
+static bool parse_index(const VmTranslator *vm, int token, int *index) {
+  char text[S64];
+  snprintf(text, sizeof text, "%.*s", vm->tokenLengths[token], vm->tokens[token]);
+  const char *bad_char = nullptr;
+  if (parse_literal(text, index, &bad_char) != LITERAL_OK) {
+    print_vm_error(vm, token, "invalid index \'%s\'", text);
+    return false;
+  }
+  return true;
+}
+
+// segments addressed through a base pointer
+static const char *pointer_segment(const VmTranslator *vm, int token) {
+  if (token_is(vm, token, "local"))
+    return "LCL";
+  if (token_is(vm, token, "argument"))
+    return "ARG";
+  if (token_is(vm, token, "this"))
+    return "THIS";
+  if (token_is(vm, token, "that"))
+    return "THAT";
+  return nullptr;
+}
+
+// segments with a fixed address: temp, pointer and static. returns false after reporting an error
+static bool fixed_segment_address(VmTranslator *vm, int index, char *symbol, size_t symbol_size, int *address) {
+  symbol[0] = '\0';
+  if (token_is(vm, 1, "temp") && index < 8) {
+    *address = TEMP_BASE + index;
+  } else if (token_is(vm, 1, "pointer") && index < 2) {
+    *address = POINTER_BASE + index;
+  } else if (token_is(vm, 1, "static")) {
+    if (snprintf(symbol, symbol_size, "%s.%d", vm->fileName, index) >= (int)symbol_size) {
+      print_vm_error(vm, 2, "static variable name is longer than %d characters", (int)symbol_size - 1);
+      return false;
+    }
+  } else if (token_is(vm, 1, "temp") || token_is(vm, 1, "pointer")) {
+    print_vm_error(vm, 2, "index %d is out of range for %.*s", index, vm->tokenLengths[1], vm->tokens[1]);
+    return false;
+  } else {
+    print_vm_error(vm, 1, "unknown segment \'%.*s\'", vm->tokenLengths[1], vm->tokens[1]);
+    return false;
+  }
+  return true;
+}
+
+static bool translate_push(VmTranslator *vm, int index) {
+  const char *base = pointer_segment(vm, 1);
+  if (token_is(vm, 1, "constant")) {
+    emit_a(vm, index);
+    emit_c(vm, C_D_A);
+  } else if (base) {
+    emit_a(vm, index);
+    emit_c(vm, C_D_A);
+    emit_a_symbol(vm, base);
+    emit_c(vm, C_A_D_PLUS_M);
+    emit_c(vm, C_D_M);
+  } else {
+    char symbol[SYMBOL_SIZE];
+    int address = 0;
+    if (!fixed_segment_address(vm, index, symbol, sizeof symbol, &address))
+      return false;
+    if (symbol[0])
+      emit_a_symbol(vm, symbol);
+    else
+      emit_a(vm, address);
+    emit_c(vm, C_D_M);
+  }
+  push_d(vm);
+  return true;
+}
+
+static bool translate_pop(VmTranslator *vm, int index) {
+  const char *base = pointer_segment(vm, 1);
+  if (token_is(vm, 1, "constant")) {
+    print_vm_error(vm, 1, "can't pop to constant");
+    return false;
+  }
+  if (base) {
+    // R13 = base + index, then *R13 = pop
+    emit_a(vm, index);
+    emit_c(vm, C_D_A);
+    emit_a_symbol(vm, base);
+    emit_c(vm, C_D_D_PLUS_M);
+    emit_a_symbol(vm, "R13");
+    emit_c(vm, C_M_D);
+    pop_d(vm);
+    emit_a_symbol(vm, "R13");
+    emit_c(vm, C_A_M);
+    emit_c(vm, C_M_D);
+    return true;
+  }
+  char symbol[SYMBOL_SIZE];
+  int address = 0;
+  if (!fixed_segment_address(vm, index, symbol, sizeof symbol, &address))
+    return false;
+  pop_d(vm);
+  if (symbol[0])
+    emit_a_symbol(vm, symbol);
+  else
+    emit_a(vm, address);
+  emit_c(vm, C_M_D);
+  return true;
+}
+
+static void translate_binary(VmTranslator *vm, VmCInstruction operation) {
+  pop_d(vm);
+  emit_c(vm, C_A_A_MINUS_1);
+  emit_c(vm, operation);
+}
+
+static void translate_unary(VmTranslator *vm, VmCInstruction operation) {
+  emit_a_symbol(vm, "SP");
+  emit_c(vm, C_A_M_MINUS_1);
+  emit_c(vm, operation);
+}
+
+// x = x - y, assume true and overwrite with false if the jump isn't taken
+static void translate_comparison(VmTranslator *vm, VmCInstruction jump) {
+  pop_d(vm);
+  emit_c(vm, C_A_A_MINUS_1);
+  emit_c(vm, C_D_M_MINUS_D);
+  emit_c(vm, C_M_MINUS_1);
+  size_t end = emit_a_rom_target(vm);
+  emit_c(vm, jump);
+  emit_a_symbol(vm, "SP");
+  emit_c(vm, C_A_M_MINUS_1);
+  emit_c(vm, C_M_0);
+  patch_rom_target(vm, end);
+}
+
+static void translate_call(VmTranslator *vm, const char *function, int argument_count) {
+  size_t return_address = emit_a_rom_target(vm);
+  emit_c(vm, C_D_A);
+  push_d(vm);
+  static const char *saved[] = {"LCL", "ARG", "THIS", "THAT"};
+  for (size_t i = 0; i < sizeof saved / sizeof saved[0]; i++) {
+    emit_a_symbol(vm, saved[i]);
+    emit_c(vm, C_D_M);
+    push_d(vm);
+  }
+  // ARG = SP - 5 - n, LCL = SP
+  emit_a_symbol(vm, "SP");
+  emit_c(vm, C_D_M);
+  emit_a(vm, argument_count + 5);
+  emit_c(vm, C_D_D_MINUS_A);
+  emit_a_symbol(vm, "ARG");
+  emit_c(vm, C_M_D);
+  emit_a_symbol(vm, "SP");
+  emit_c(vm, C_D_M);
+  emit_a_symbol(vm, "LCL");
+  emit_c(vm, C_M_D);
+  module_emit_label_reference(vm->module, function);
+  emit_c(vm, C_0_JMP);
+  patch_rom_target(vm, return_address);
+}
+
+static void translate_return(VmTranslator *vm) {
+  // R13 = frame = LCL, R14 = return address = *(frame - 5)
+  emit_a_symbol(vm, "LCL");
+  emit_c(vm, C_D_M);
+  emit_a_symbol(vm, "R13");
+  emit_c(vm, C_M_D);
+  emit_a(vm, 5);
+  emit_c(vm, C_A_D_MINUS_A);
+  emit_c(vm, C_D_M);
+  emit_a_symbol(vm, "R14");
+  emit_c(vm, C_M_D);
+  // *ARG = pop, SP = ARG + 1
+  pop_d(vm);
+  emit_a_symbol(vm, "ARG");
+  emit_c(vm, C_A_M);
+  emit_c(vm, C_M_D);
+  emit_a_symbol(vm, "ARG");
+  emit_c(vm, C_D_M_PLUS_1);
+  emit_a_symbol(vm, "SP");
+  emit_c(vm, C_M_D);
+  static const char *restored[] = {"THAT", "THIS", "ARG", "LCL"};
+  for (size_t i = 0; i < sizeof restored / sizeof restored[0]; i++) {
+    emit_a_symbol(vm, "R13");
+    emit_c(vm, C_AM_M_MINUS_1);
+    emit_c(vm, C_D_M);
+    emit_a_symbol(vm, restored[i]);
+    emit_c(vm, C_M_D);
+  }
+  emit_a_symbol(vm, "R14");
+  emit_c(vm, C_A_M);
+  emit_c(vm, C_0_JMP);
+}
+
+static void tokenize(VmTranslator *vm) {
+  vm->tokenCount = 0;
+  const char *c = vm->line;
+  while (*c) {
+    while (*c == ' ' || *c == '\t')
+      c++;
+    if (!*c)
+      break;
+    const char *start = c;
+    while (*c && *c != ' ' && *c != '\t')
+      c++;
+    if (vm->tokenCount == VM_MAX_TOKENS) {
+      vm->tokenCount++; // flagged as too many by the caller
+      return;
+    }
+    vm->tokens[vm->tokenCount] = start;
+    vm->tokenLengths[vm->tokenCount] = (int)(c - start);
+    vm->tokenCount++;
+  }
+}
+
+static bool expect_tokens(const VmTranslator *vm, int count) {
+  if (vm->tokenCount < count) {
+    print_vm_error(vm, vm->tokenCount, "missing %s", count - vm->tokenCount == 1 ? "argument" : "arguments");
+    return false;
+  }
+  if (vm->tokenCount > count) {
+    print_vm_error(vm, count, "unexpected argument");
+    return false;
+  }
+  return true;
+}
+
+static bool translate_command(VmTranslator *vm) {
+  static const struct {
+    const char *name;
+    VmCInstruction operation;
+    bool unary;
+    bool comparison;
+  } arithmetic[] = {
+      {"add", C_M_D_PLUS_M, false, false}, {"sub", C_M_M_MINUS_D, false, false}, {"and", C_M_D_AND_M, false, false},
+      {"or", C_M_D_OR_M, false, false},    {"neg", C_M_NEG_M, true, false},       {"not", C_M_NOT_M, true, false},
+      {"eq", C_D_JEQ, false, true},        {"gt", C_D_JGT, false, true},          {"lt", C_D_JLT, false, true},
+  };
+  for (size_t i = 0; i < sizeof arithmetic / sizeof arithmetic[0]; i++) {
+    if (!token_is(vm, 0, arithmetic[i].name))
+      continue;
+    if (!expect_tokens(vm, 1))
+      return false;
+    if (arithmetic[i].comparison)
+      translate_comparison(vm, arithmetic[i].operation);
+    else if (arithmetic[i].unary)
+      translate_unary(vm, arithmetic[i].operation);
+    else
+      translate_binary(vm, arithmetic[i].operation);
+    return true;
+  }
+
+  int number = 0;
+  if (token_is(vm, 0, "push") || token_is(vm, 0, "pop")) {
+    if (!expect_tokens(vm, 3) || !parse_index(vm, 2, &number))
+      return false;
+    return token_is(vm, 0, "push") ? translate_push(vm, number) : translate_pop(vm, number);
+  }
+
+  char symbol[SYMBOL_SIZE];
+  if (token_is(vm, 0, "label") || token_is(vm, 0, "goto") || token_is(vm, 0, "if-goto")) {
+    if (!expect_tokens(vm, 2))
+      return false;
+    if (snprintf(symbol, sizeof symbol, "%s$%.*s", vm->function, vm->tokenLengths[1], vm->tokens[1]) >=
+        (int)sizeof symbol) {
+      print_vm_error(vm, 1, "label name function$label is longer than %d characters", (int)sizeof symbol - 1);
+      return false;
+    }
+    if (token_is(vm, 0, "label")) {
+      if (!module_define_label(vm->module, symbol)) {
+        print_vm_error(vm, 1, "duplicate label \'%s\'", symbol);
+        return false;
+      }
+      return true;
+    }
+    add_entry(&vm->jumpTargets, symbol, vm->lineNumber);
+    if (token_is(vm, 0, "goto")) {
+      emit_a_symbol(vm, symbol);
+      emit_c(vm, C_0_JMP);
+    } else {
+      pop_d(vm);
+      emit_a_symbol(vm, symbol);
+      emit_c(vm, C_D_JNE);
+    }
+    return true;
+  }
+
+  if (token_is(vm, 0, "function") || token_is(vm, 0, "call")) {
+    if (!expect_tokens(vm, 3) || !parse_index(vm, 2, &number))
+      return false;
+    snprintf(symbol, sizeof symbol, "%.*s", vm->tokenLengths[1], vm->tokens[1]);
+    if (token_is(vm, 0, "call")) {
+      // ARG = SP - 5 - n loads 5 + n with an A-instruction
+      if (number > MAX_CONSTANT_SIZE - 5) {
+        print_vm_error(vm, 2, "argument count %d is larger than %d", number, MAX_CONSTANT_SIZE - 5);
+        return false;
+      }
+      translate_call(vm, symbol, number);
+      return true;
+    }
+    snprintf(vm->function, sizeof vm->function, "%s", symbol);
+    if (!module_define_label(vm->module, symbol)) {
+      print_vm_error(vm, 1, "duplicate function \'%s\'", symbol);
+      return false;
+    }
+    // functions are called across files, function$label labels stay local
+    module_export(vm->module, symbol, vm->lineNumber);
+    for (int i = 0; i < number; i++) {
+      emit_a_symbol(vm, "SP");
+      emit_c(vm, C_AM_M_PLUS_1);
+      emit_c(vm, C_A_A_MINUS_1);
+      emit_c(vm, C_M_0);
+    }
+    return true;
+  }
+
+  if (token_is(vm, 0, "return")) {
+    if (!expect_tokens(vm, 1))
+      return false;
+    translate_return(vm);
+    return true;
+  }
+
+  print_vm_error(vm, 0, "unknown command \'%.*s\'", vm->tokenLengths[0], vm->tokens[0]);
+  return false;
+}
+
+// returns false if the file name is too long to prefix static variables
+static bool vm_translator_init(VmTranslator *vm, Module *module, const char *filename) {
+  init_c_words();
+  vm->module = module;
+  const char *base = strrchr(filename, '/');
+  base = base ? base + 1 : filename;
+  size_t len = strlen(base);
+  if (str_ends_with(base, ".vm"))
+    len -= 3;
+  snprintf(vm->fileName, sizeof vm->fileName, "%.*s", (int)len, base);
+  snprintf(vm->function, sizeof vm->function, "%s", vm->fileName);
+  vm->line = "";
+  vm->lineNumber = 0;
+  vm->tokenCount = 0;
+  symbol_table_init(&vm->jumpTargets);
+  return len < sizeof vm->fileName;
+}
+
+static void vm_translator_destroy(VmTranslator *vm) { symbol_table_destroy(&vm->jumpTargets); }
+
+// labels are local to their function, so a jump to one that was never defined can't be left to the linker
+static bool check_jump_targets(const VmTranslator *vm, const char *filename) {
+  bool ok = true;
+  for (size_t i = 0; i < vm->jumpTargets.capacity; i++) {
+    const Symbol *target = &vm->jumpTargets.entries[i];
+    if (target->name && !contains(&vm->module->labels, target->name)) {
+      fprintf(stderr, "[ERROR] %s: label \'%s\' on line %d is not defined in its function\n", filename, target->name,
+              target->address);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// translates one .vm file into a relocatable module, returns false on any error
+bool translate_vm_file(const char *filename, Module *module) {
+  Parser p;
+  Parser *parser = &p;
+  parser_init(parser, filename);
+  if (!parser->inputFile) {
+    return false;
+  }
+  VmTranslator vm;
+  bool has_errors = false;
+  if (!vm_translator_init(&vm, module, filename)) {
+    fprintf(stderr, "[ERROR] %s: file name is longer than %d characters\n", filename, SYMBOL_SIZE - 1);
+    has_errors = true;
+  }
+
+  while (advance(parser)) {
+    vm.line = parser->currentInstruction;
+    vm.lineNumber = parser->lineNumber;
+    tokenize(&vm);
+    if (parser->errorStatus || !translate_command(&vm)) {
+      has_errors = true;
+      parser->errorStatus = false;
+    }
+    if (module->codeCount > ROM_SIZE) {
+      fprintf(stderr, "[ERROR] %s doesn't fit in the %d word ROM, line %d is past the end\n", filename, ROM_SIZE,
+              parser->lineNumber);
+      has_errors = true;
+      break;
+    }
+  }
+  parser_destroy(parser);
+
+  if (!has_errors) {
+    has_errors = !check_jump_targets(&vm, filename);
+  }
+  vm_translator_destroy(&vm);
+  if (!has_errors) {
+    module_finalize(module);
+  }
+  return !has_errors;
+}
+
+// the bootstrap is only needed for programs with a Sys.init entry point. decided from the exported
+// labels, so it's the same whether Sys.vm is translated now or loaded from its .hobj
+bool needs_vm_bootstrap(const Module *modules, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (contains(&modules[i].labels, "Sys.init")) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// SP = 256, call Sys.init
+void vm_bootstrap(Module *module) {
+  VmTranslator vm;
+  vm_translator_init(&vm, module, "bootstrap");
+  emit_a(&vm, STACK_BASE);
+  emit_c(&vm, C_D_A);
+  emit_a_symbol(&vm, "SP");
+  emit_c(&vm, C_M_D);
+  translate_call(&vm, "Sys.init", 0);
+  vm_translator_destroy(&vm);
+  module_finalize(module);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "module.h"
+
+bool translate_vm_file(const char *filename, Module *module);
+bool needs_vm_bootstrap(const Module *modules, size_t count);
+void vm_bootstrap(Module *module);
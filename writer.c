@@ -4,7 +4,9 @@
 #include "strlib.h"
 #include "types.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 void writer_init(Writer *writer, const char *output_filename) {
@@ -12,6 +14,7 @@ void writer_init(Writer *writer, const char *output_filename) {
   if (!file) {
     fprintf(stderr, "Error opening file '%s': ", output_filename);
     perror("");
+    writer->outputFile = nullptr;
     return;
   }
 
@@ -19,38 +22,61 @@ void writer_init(Writer *writer, const char *output_filename) {
 }
 
 
-void assemble_bits(Parser *parser, TranslatedCode *code, Writer *writer) {
+uint16_t assemble_bits(Parser *parser, TranslatedCode *code) {
   InstructionType type = parser->type;
+  uint16_t word = 0;
   switch (type) {
   case A_INSTRUCTION:
-    if (is_constant(parser->symbol)) {
-      const size_t buf_size = 17;
-      char bit_string[17];
-      int_str_to_bit_str(parser->symbol, bit_string, buf_size);
-      snprintf(writer->output, sizeof writer->output, "%s", bit_string);
+    if (parser->isConstant) {
+      word = (uint16_t)parser->constValue;
     }
     break;
-  case C_INTRUCTION:
-    snprintf(writer->output, sizeof writer->output, "111%s%s%s", code->comp, code->dest, code->jump);
+  case C_INTRUCTION: {
+    char bit_string[17];
+    snprintf(bit_string, sizeof bit_string, "111%s%s%s", code->comp, code->dest, code->jump);
+    word = (uint16_t)strtol(bit_string, nullptr, 2);
     break;
+  }
   default:
   }
-  print_debug(dbg, "bits assembled: \"%s\"\n", writer->output);
+  print_debug(dbg, "bits assembled: 0x%04X\n", word);
+  return word;
 }
 
-void write_output(Writer *writer) {
-  if (fprintf(writer->outputFile, "%s\n", writer->output) == EOF) {
-    perror("fputs failed");
-    return;
+// formats the ROM a chunk at a time and hands each chunk to a single fwrite
+bool write_rom(Writer *writer, const uint16_t *rom, size_t rom_size) {
+  enum { WORD_LINE_SIZE = 17, WORDS_PER_CHUNK = 4096 };
+  static char chunk[WORDS_PER_CHUNK * WORD_LINE_SIZE];
+  for (size_t start = 0; start < rom_size; start += WORDS_PER_CHUNK) {
+    size_t words = rom_size - start < WORDS_PER_CHUNK ? rom_size - start : WORDS_PER_CHUNK;
+    char *line = chunk;
+    for (size_t i = 0; i < words; i++) {
+      uint16_t word = rom[start + i];
+      for (int bit = 0; bit < 16; bit++) {
+        line[bit] = (char)('0' + ((word >> (15 - bit)) & 1));
+      }
+      line[16] = '\n';
+      line += WORD_LINE_SIZE;
+    }
+    if (fwrite(chunk, WORD_LINE_SIZE, words, writer->outputFile) != words) {
+      perror("fwrite failed");
+      return false;
+    }
   }
+  return true;
 }
 
-void writer_destroy(Writer *writer) {
+// closes the output file, returns false if buffered output couldn't be flushed
+bool writer_destroy(Writer *writer) {
   if (!writer) {
-    return;
+    return true;
   }
+  bool ok = true;
   if (writer->outputFile) {
-    fclose(writer->outputFile);
+    ok = !ferror(writer->outputFile);
+    if (fclose(writer->outputFile) != 0)
+      ok = false;
+    writer->outputFile = nullptr;
   }
-  writer = nullptr;
+  return ok;
 }
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "types.h"
+#include <stddef.h>
+#include <stdint.h>
 
 void writer_init(Writer *writer, const char *output_filename);
-void assemble_bits(Parser *parser, TranslatedCode *code, Writer *writer);
-void write_output(Writer *writer);
-void writer_destroy(Writer *writer);
+uint16_t assemble_bits(Parser *parser, TranslatedCode *code);
+bool write_rom(Writer *writer, const uint16_t *rom, size_t rom_size);
+bool writer_destroy(Writer *writer);